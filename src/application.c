@@ -44,6 +44,12 @@
 #include "report.h"
 #include "window.h"
 #include "xhandler.h"
+#include "area.h"
+#include "timeline.h"
+#include "visual.h"
+#include "recorder.h"
+#include "present.h"
+#include "compositor.h"
 
 /**
  * The application management data.
@@ -71,14 +77,27 @@ static monitor_t monitor = {
 response_t response = {
 		.last_action_name = "",
 		.timeout = 0,
+		.settle = 0,
+		.settle_timestamp = {
+				.tv_sec = 0,
+				.tv_usec = 0,
+		},
 		.last_action_timestamp = {
 				.tv_sec = 0,
 				.tv_usec = 0,
 		},
 		.last_action_time = 0,
+		.input_queued = -1,
+		.input_delivery = -1,
 		.application = NULL,
 };
 
+/* the response data at the start of a measurement session */
+static const response_t response_defaults = {
+		.input_queued = -1,
+		.input_delivery = -1,
+};
+
 
 /**
  * Adds a new application to the monitored application list.
@@ -93,9 +112,15 @@ static application_t* application_add(const char* name)
 {
 	application_t* app = g_slice_new(application_t);
 	app->name = g_strdup(name);
+	app->interned_name = g_intern_string(name);
 	app->ref = 1;
 	memset(&app->first_damage_event, 0, sizeof(XDamageNotifyEvent));
 	memset(&app->last_damage_event, 0, sizeof(XDamageNotifyEvent));
+	region_init(&app->damage);
+	region_init(&app->frame);
+	app->frames = 0;
+	app->frame_area_max = 0;
+	app->monitored = true;
 	monitor.applications = g_list_prepend(monitor.applications, app);
 	return app;
 }
@@ -109,6 +134,8 @@ static application_t* application_add(const char* name)
 static void application_free(application_t* app, void* __attribute__((unused)) data)
 {
 	if (app->name) free(app->name);
+	region_free(&app->damage);
+	region_free(&app->frame);
 	g_slice_free(application_t, app);
 }
 
@@ -179,9 +206,12 @@ static void application_reset_events(application_t* app)
 static void report_app_damage_event(application_t* app, void* __attribute__((unused)) data)
 {
 	if (app->first_damage_event.timestamp) {
-		report_add_message_forced("\t%32s updates: first %5ims, last %5ims\n",
+		report_add_message_forced("\t%32s updates: first %5ims, last %5ims, frames %u, area %llupx "
+				"(max frame %llupx), overdraw %.2f\n",
 				app->name ? app->name : "(unknown)",
-				app->first_damage_event.timestamp - response.last_action_time, app->last_damage_event.timestamp - response.last_action_time);
+				app->first_damage_event.timestamp - response.last_action_time, app->last_damage_event.timestamp - response.last_action_time,
+				app->frames, region_area(&app->damage), app->frame_area_max, region_overdraw(&app->damage));
+		present_report_application(app, response.last_action_time, app->last_damage_event.timestamp);
 		app->first_damage_event.timestamp = 0;
 		application_release_data(app, NULL);
 	}
@@ -203,11 +233,21 @@ static void application_report_response_data()
 		if (monitor.screen && monitor.screen->first_damage_event.timestamp) {
 			response.application->first_damage_event.timestamp = monitor.screen->first_damage_event.timestamp;
 			response.application->last_damage_event.timestamp = monitor.screen->last_damage_event.timestamp;
+			region_clear(&response.application->damage);
+			region_merge(&response.application->damage, &monitor.screen->damage);
+			response.application->frames = monitor.screen->frames;
+			response.application->frame_area_max = monitor.screen->frame_area_max;
 			application_addref(response.application);
 		}
 	}
 
+	if (response.input_delivery >= 0) {
+		report_add_message_forced("\t%32s queued %.1fms, delivery %.1fms\n", "(input injection)",
+				response.input_queued / 1000.0, response.input_delivery / 1000.0);
+	}
 	g_list_foreach(monitor.applications, (GFunc)report_app_damage_event, NULL);
+	compositor_response_report();
+	area_response_report(response.last_action_time);
 	report_add_message_forced("\n");
 	application_release_data(response.application, NULL);
 }
@@ -227,6 +267,7 @@ application_t* application_monitor(const char* name)
 	}
 	else {
 		application_addref(app);
+		app->monitored = true;
 	}
 	return app;
 }
@@ -236,25 +277,49 @@ void application_init()
 {
 	monitor.applications = NULL;
 	monitor.screen = NULL;
-	response.application = NULL;
+	monitor.all = false;
+	response = response_defaults;
 }
 
 
 void application_fini()
 {
 	g_list_foreach(monitor.applications, (GFunc)application_free, NULL);
+	g_list_free(monitor.applications);
+	monitor.applications = NULL;
 	monitor.screen = NULL;
 	response.application = NULL;
 }
 
 
+void application_reset()
+{
+	GList* node;
+
+	for (node = monitor.applications; node; node = node->next) {
+		application_t* app = node->data;
+		application_reset_events(app);
+		memset(&app->first_damage_event, 0, sizeof(XDamageNotifyEvent));
+		memset(&app->last_damage_event, 0, sizeof(XDamageNotifyEvent));
+		region_clear(&app->damage);
+		region_clear(&app->frame);
+		app->frames = 0;
+		app->frame_area_max = 0;
+		app->monitored = false;
+	}
+	monitor.screen = NULL;
+	monitor.all = false;
+	response = response_defaults;
+}
+
+
 
 
 void application_start_monitor()
 {
 	Window win = DefaultRootWindow(xhandler.display);
 	window_try_monitor(win);
-	window_try_monitor_children(win);
+	window_scan_end();
 }
 
 
@@ -266,7 +331,7 @@ void application_set_monitor_all(bool value)
 application_t* application_try_monitor(const char* resource)
 {
 	application_t* app = application_find(resource);
-	if (app) {
+	if (app && app->monitored) {
 		application_addref(app);
 		return app;
 	}
@@ -286,6 +351,27 @@ void application_response_report()
 		 * just suppressing them at reporter level.
 		 */
 		report_add_message_forced("Device response time to %s:\n", response.last_action_name);
+
+		struct timeval end, diff;
+		if (timerisset(&response.settle_timestamp)) {
+			end = response.settle_timestamp;
+		}
+		else {
+			gettimeofday(&end, NULL);
+		}
+		timersub(&end, &response.last_action_timestamp, &diff);
+		long settle = diff.tv_sec * 1000 + diff.tv_usec / 1000;
+		if (response.settle) {
+			if (timerisset(&response.settle_timestamp)) {
+				report_add_message_forced("\t%32s settled after %lims\n", "(screen)", settle);
+			}
+			else {
+				report_add_message_forced("\t%32s not settled in %lims\n", "(screen)", settle);
+			}
+		}
+		visual_finish();
+		recorder_finish(response.last_action_time);
+		timeline_finish(response.last_action_name, settle);
 		application_report_response_data();
 		response.last_action_time = 0;
 		response.last_action_timestamp.tv_sec = 0;
@@ -305,10 +391,37 @@ void application_response_reset(Time timestamp)
 		}
 		response.last_action_time = timestamp;
 		gettimeofday(&response.last_action_timestamp, NULL);
+		response.input_queued = -1;
+		response.input_delivery = -1;
+		timerclear(&response.settle_timestamp);
+		timeline_start(timestamp);
+		visual_start(&response.last_action_timestamp);
+		present_start();
+		compositor_start(timestamp);
 	}
 }
 
 
+void application_response_set_delivery(int queued, int delivery)
+{
+	response.input_queued = queued;
+	response.input_delivery = delivery;
+	timeline_set_delivery(queued, delivery);
+}
+
+
+bool application_response_settled(struct timeval* now)
+{
+	if (response.settle) {
+		if (area_settled(&response.last_action_timestamp, now, response.settle, &response.settle_timestamp)) {
+			return true;
+		}
+		timerclear(&response.settle_timestamp);
+	}
+	return check_timeval_timeout(&response.last_action_timestamp, now, response.timeout);
+}
+
+
 void application_set_user_action(const char* format, ...)
 {
 	va_list ap;
@@ -330,11 +443,37 @@ void application_response_start(application_t* app)
 
 void application_register_damage(application_t* app, XDamageNotifyEvent* dev)
 {
+	/* ignore buffered damage preceding the user action */
+	if (dev->timestamp < response.last_action_time) return;
+
+	timeline_register_damage(dev);
+
 	if (app->first_damage_event.timestamp < response.last_action_time) {
 		app->first_damage_event = *dev;
 		application_addref(app);
+		region_clear(&app->damage);
+		region_clear(&app->frame);
+		app->frames = 0;
+		app->frame_area_max = 0;
+	}
+	/* damage buffered for windows waiting for admission can be processed out of order */
+	if (dev->timestamp >= app->last_damage_event.timestamp) {
+		app->last_damage_event = *dev;
+	}
+
+	int x = dev->area.x + dev->geometry.x;
+	int y = dev->area.y + dev->geometry.y;
+	region_add(&app->damage, x, y, dev->area.width, dev->area.height);
+	region_add(&app->frame, x, y, dev->area.width, dev->area.height);
+
+	/* the damage events of a single update are reported with 'more' flag set
+	 * for all but the last event */
+	if (!dev->more) {
+		unsigned long long area = region_area(&app->frame);
+		if (area > app->frame_area_max) app->frame_area_max = area;
+		region_clear(&app->frame);
+		app->frames++;
 	}
-	app->last_damage_event = *dev;
 }
 
 void application_monitor_screen()
@@ -344,7 +483,16 @@ void application_monitor_screen()
 
 bool application_empty()
 {
-	return monitor.applications == NULL;
+	GList* node;
+	for (node = monitor.applications; node; node = node->next) {
+		if (((application_t*)node->data)->monitored) return false;
+	}
+	return true;
+}
+
+bool application_is_monitored(application_t* app)
+{
+	return app->monitored;
 }
 
 void application_addref(application_t* app)
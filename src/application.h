@@ -51,6 +51,8 @@
 #include <X11/extensions/Xdamage.h>
 #include <X11/extensions/record.h>
 
+#include "region.h"
+
 /**
  * Application data structure.
  */
@@ -58,12 +60,30 @@ typedef struct application_t {
 	/* the application resource name (binary file) */
 	char* name;
 
+	/* the interned application name, compared by damage filter rules */
+	const char* interned_name;
+
 	/* the first damage event after user action */
 	XDamageNotifyEvent first_damage_event;
 
 	/* the last damage event after user action */
 	XDamageNotifyEvent last_damage_event;
 
+	/* the damaged region after user action */
+	region_t damage;
+
+	/* the damaged region of the current frame */
+	region_t frame;
+
+	/* number of frames (damage event sequences) after user action */
+	unsigned int frames;
+
+	/* the largest area covered by a single frame */
+	unsigned long long frame_area_max;
+
+	/* true if the application windows are monitored in the current measurement session */
+	bool monitored;
+
 	/* reference counter */
 	int ref;
 } application_t;
@@ -76,14 +96,29 @@ typedef struct {
 	/* the last user action in user friendly format */
 	char last_action_name[256];
 
-	/* application response checking timeout */
+	/* application response checking timeout, the hard cap of response checking
+	 * when settle detection is enabled */
 	unsigned int timeout;
 
+	/* the default quiet period (msecs) ending response checking, 0 if the
+	 * settle detection is disabled */
+	unsigned int settle;
+	/* the local time the monitored areas settled after the last user action,
+	 * cleared if they have not settled */
+	struct timeval settle_timestamp;
+
 	/* last user action time */
 	Time last_action_time;
 	/* local timestamp of the last user action */
 	struct timeval last_action_timestamp;
 
+	/* the delay between the scheduled and actual injection of the last user
+	 * action (usecs), -1 if the action was not injected by xresponse */
+	int input_queued;
+	/* the delay between the injection and the recording of the last user
+	 * action (usecs), -1 if the action was not injected by xresponse */
+	int input_delivery;
+
 	/* the application for response data monitoring */
 	application_t* application;
 } response_t;
@@ -115,8 +150,19 @@ void application_init();
 void application_fini();
 
 
+/**
+ * Resets the application monitoring at the end of a measurement session.
+ *
+ * The application list is kept for the next session in daemon mode, but the
+ * applications are no longer monitored and their response data is cleared.
+ */
+void application_reset();
+
+
 /**
  * Starts to monitor all windows associated to the monitored applications.
+ *
+ * Completes the window tree scan started by window_scan_begin().
  */
 void application_start_monitor();
 
@@ -137,6 +183,18 @@ void application_set_monitor_all(bool value);
 void application_response_report();
 
 
+/**
+ * Checks if the response checking of the last user action has ended.
+ *
+ * Without settle detection the response checking ends after the response
+ * timeout. With settle detection it ends when all monitored areas have
+ * settled, or after the response timeout.
+ * @param[in] now   the current local time.
+ * @return          true if the response checking has ended.
+ */
+bool application_response_settled(struct timeval* now);
+
+
 /**
  * Stores last user action description.
  *
@@ -171,12 +229,21 @@ void application_monitor_screen();
 
 
 /**
- * Checks if the monitored application list is empty.
+ * Checks if no applications are monitored in the current session.
  *
- * @return   true if the monitored application list is empty.
+ * @return   true if no applications are monitored.
  */
 bool application_empty();
 
+
+/**
+ * Checks if the application is monitored in the current session.
+ *
+ * @param[in] app   the application.
+ * @return          true if the application is monitored.
+ */
+bool application_is_monitored(application_t* app);
+
 /**
  * Attempts to monitor the specified application.
  *
@@ -216,4 +283,16 @@ void application_release(application_t* app);
  */
 void application_response_reset(Time timestamp);
 
+
+/**
+ * Sets the input delivery latency of the last user action.
+ *
+ * Called after application_response_reset() for user actions injected
+ * by xresponse, so the response report can separate the input delivery
+ * from the application response.
+ * @param[in] queued     the delay between scheduled and actual injection (usecs).
+ * @param[in] delivery   the delay between injection and recording (usecs).
+ */
+void application_response_set_delivery(int queued, int delivery);
+
 #endif
@@ -0,0 +1,291 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "area.h"
+#include "report.h"
+
+/**
+ * Monitored areas data structure.
+ */
+typedef struct {
+	/* the monitored areas */
+	area_t areas[AREA_MAX];
+	/* the number of monitored areas */
+	int count;
+	/* the area index grid, rows * columns */
+	area_mask_t* grid;
+	int columns;
+	int rows;
+} areas_t;
+
+static areas_t areas = {
+		.count = 0,
+		.grid = NULL,
+};
+
+
+/**
+ * Checks if the rectangle overlaps the area.
+ *
+ * The area edges are inclusive.
+ */
+static bool area_overlaps(const area_t* area, int x, int y, int width, int height)
+{
+	return x + width >= area->rect.x && x <= area->rect.x + area->rect.width &&
+			y + height >= area->rect.y && y <= area->rect.y + area->rect.height;
+}
+
+
+/**
+ * Converts coordinate to grid cell index, clipped to the grid.
+ */
+static int grid_index(int value, int size)
+{
+	int index = value / AREA_GRID_CELL_SIZE;
+	if (value < 0 || index < 0) return 0;
+	if (index >= size) return size - 1;
+	return index;
+}
+
+
+/**
+ * Checks if the area statistics must be reported.
+ */
+static bool area_reporting()
+{
+	return areas.count > 1 || areas.areas[0].name;
+}
+
+
+/**
+ * Retrieves area name for reporting.
+ */
+static const char* area_name(const area_t* area, char* buffer, int size)
+{
+	if (area->name) return area->name;
+	snprintf(buffer, size, "%dx%d+%d+%d", area->rect.width, area->rect.height, area->rect.x, area->rect.y);
+	return buffer;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+area_t* area_add(const char* name, const Rectangle* rect)
+{
+	if (areas.count == AREA_MAX) return NULL;
+
+	area_t* area = &areas.areas[areas.count++];
+	area->name = name && *name ? g_strdup(name) : NULL;
+	area->rect = *rect;
+	area->action = 0;
+	area->first_damage = 0;
+	area->last_damage = 0;
+	area->events = 0;
+	area->pixels = 0;
+	area->quiet = 0;
+	timerclear(&area->settle_damage);
+	return area;
+}
+
+
+area_t* area_find(const char* name)
+{
+	int i;
+	for (i = 0; i < areas.count; i++) {
+		if (areas.areas[i].name && !strcmp(areas.areas[i].name, name)) return &areas.areas[i];
+	}
+	return NULL;
+}
+
+
+void area_init(int width, int height)
+{
+	int i, row, column;
+
+	if (!areas.count) {
+		Rectangle screen = {.x = 0, .y = 0, .width = width, .height = height};
+		area_add(NULL, &screen);
+	}
+
+	areas.columns = (width + AREA_GRID_CELL_SIZE - 1) / AREA_GRID_CELL_SIZE;
+	areas.rows = (height + AREA_GRID_CELL_SIZE - 1) / AREA_GRID_CELL_SIZE;
+	if (!areas.columns) areas.columns = 1;
+	if (!areas.rows) areas.rows = 1;
+
+	g_free(areas.grid);
+	areas.grid = g_new0(area_mask_t, areas.columns * areas.rows);
+
+	for (i = 0; i < areas.count; i++) {
+		Rectangle* rect = &areas.areas[i].rect;
+		int column_end = grid_index(rect->x + rect->width, areas.columns);
+		int row_end = grid_index(rect->y + rect->height, areas.rows);
+
+		for (row = grid_index(rect->y, areas.rows); row <= row_end; row++) {
+			for (column = grid_index(rect->x, areas.columns); column <= column_end; column++) {
+				areas.grid[row * areas.columns + column] |= (area_mask_t)1 << i;
+			}
+		}
+	}
+}
+
+
+void area_fini()
+{
+	int i;
+	for (i = 0; i < areas.count; i++) {
+		g_free(areas.areas[i].name);
+	}
+	areas.count = 0;
+	g_free(areas.grid);
+	areas.grid = NULL;
+}
+
+
+area_mask_t area_match(int x, int y, int width, int height)
+{
+	area_mask_t candidates = 0, mask = 0;
+	int row, column;
+	int column_start = grid_index(x, areas.columns);
+	int column_end = grid_index(x + width, areas.columns);
+	int row_end = grid_index(y + height, areas.rows);
+
+	for (row = grid_index(y, areas.rows); row <= row_end; row++) {
+		area_mask_t* cells = areas.grid + row * areas.columns;
+		for (column = column_start; column <= column_end; column++) {
+			candidates |= cells[column];
+		}
+	}
+
+	while (candidates) {
+		int i = __builtin_ctzll(candidates);
+		if (area_overlaps(&areas.areas[i], x, y, width, height)) mask |= (area_mask_t)1 << i;
+		candidates &= candidates - 1;
+	}
+	return mask;
+}
+
+
+void area_register_damage(area_mask_t mask, int x, int y, int width, int height, Time timestamp, Time action)
+{
+	for (; mask; mask &= mask - 1) {
+		area_t* area = &areas.areas[__builtin_ctzll(mask)];
+		/* clip the damage to the area */
+		int x1 = MAX(x, area->rect.x);
+		int y1 = MAX(y, area->rect.y);
+		int x2 = MIN(x + width, area->rect.x + area->rect.width);
+		int y2 = MIN(y + height, area->rect.y + area->rect.height);
+
+		/* the damage only touching the inclusive area edges doesn't damage the area */
+		if (x1 >= x2 || y1 >= y2) continue;
+
+		area->events++;
+		area->pixels += (unsigned long)(x2 - x1) * (y2 - y1);
+		if (action && timestamp >= action) {
+			if (area->action != action) {
+				area->action = action;
+				area->first_damage = timestamp;
+			}
+			area->last_damage = timestamp;
+		}
+	}
+}
+
+
+void area_register_settle_damage(area_mask_t mask)
+{
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	while (mask) {
+		areas.areas[__builtin_ctzll(mask)].settle_damage = now;
+		mask &= mask - 1;
+	}
+}
+
+
+bool area_settled(const struct timeval* action, const struct timeval* now, unsigned int quiet, struct timeval* settle)
+{
+	int i;
+
+	*settle = *action;
+	for (i = 0; i < areas.count; i++) {
+		area_t* area = &areas.areas[i];
+		unsigned int period = area->quiet ? area->quiet : quiet;
+		struct timeval end, delay = {.tv_sec = period / 1000, .tv_usec = period % 1000 * 1000};
+
+		/* the quiet period starts with the user action or the last damage after it */
+		timeradd(timercmp(&area->settle_damage, action, >) ? &area->settle_damage : action, &delay, &end);
+		if (timercmp(&end, now, >)) return false;
+		if (timercmp(&end, settle, >)) *settle = end;
+	}
+	return true;
+}
+
+
+void area_response_report(Time action)
+{
+	int i;
+	char buffer[64];
+
+	for (i = 0; i < areas.count; i++) {
+		area_t* area = &areas.areas[i];
+		if (area->action == action && area_reporting()) {
+			report_add_message_forced("\t%32s area updates: first %5ims, last %5ims\n",
+					area_name(area, buffer, sizeof(buffer)), area->first_damage - action, area->last_damage - action);
+		}
+	}
+}
+
+
+void area_report()
+{
+	int i;
+	char buffer[64];
+
+	if (!areas.count || !area_reporting()) return;
+
+	report_add_message_forced("Monitored area damage:\n");
+	for (i = 0; i < areas.count; i++) {
+		area_t* area = &areas.areas[i];
+		report_add_message_forced("\t%32s %8lu events, %12llu pixels\n", area_name(area, buffer, sizeof(buffer)),
+				area->events, area->pixels);
+	}
+	report_add_message_forced("\n");
+}
@@ -0,0 +1,193 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file area.h
+ * Monitored screen areas.
+ *
+ * area.c|h files manage the screen areas specified with --monitor options.
+ * Damage events outside all monitored areas are ignored. Every area collects
+ * its own damage statistics and response times.
+ *
+ * The areas are indexed by a coarse screen grid, where every cell has a bit
+ * mask of the areas overlapping it. This allows to find the areas matching
+ * a damage event without checking all areas.
+ */
+
+#ifndef _AREA_H_
+#define _AREA_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <X11/Xlib.h>
+
+#include "xresponse.h"
+
+/* the maximum number of monitored areas */
+#define AREA_MAX		64
+
+/* the area index grid cell size (in pixels) */
+#define AREA_GRID_CELL_SIZE	64
+
+/* area bit mask, one bit per area */
+typedef uint64_t area_mask_t;
+
+/**
+ * Monitored area data structure.
+ */
+typedef struct {
+	/* the area name (can be NULL) */
+	char* name;
+	/* the area rectangle */
+	Rectangle rect;
+	/* the user action the response times are collected for */
+	Time action;
+	/* the first damage after user action */
+	Time first_damage;
+	/* the last damage after user action */
+	Time last_damage;
+	/* number of damage events */
+	unsigned long events;
+	/* number of damaged pixels */
+	unsigned long long pixels;
+	/* the quiet period (msecs) after which the area is settled, 0 for the default */
+	unsigned int quiet;
+	/* the local time of the last damage resetting the quiet period */
+	struct timeval settle_damage;
+} area_t;
+
+
+/**
+ * Adds a new monitored area.
+ *
+ * @param[in] name     the area name (can be NULL).
+ * @param[in] rect     the area rectangle.
+ * @return             the added area or NULL if too many areas were specified.
+ */
+area_t* area_add(const char* name, const Rectangle* rect);
+
+
+/**
+ * Finds a named monitored area.
+ *
+ * @param[in] name     the area name.
+ * @return             the area or NULL if no area has the specified name.
+ */
+area_t* area_find(const char* name);
+
+
+/**
+ * Initializes monitored areas.
+ *
+ * If no areas were added the whole screen is monitored. This function
+ * must be called after all areas are added and before damage processing.
+ * @param[in] width    the screen width.
+ * @param[in] height   the screen height.
+ */
+void area_init(int width, int height);
+
+
+/**
+ * Releases resources allocated by monitored areas.
+ */
+void area_fini();
+
+
+/**
+ * Finds the monitored areas overlapping the specified rectangle.
+ *
+ * @param[in] x        the rectangle left coordinate.
+ * @param[in] y        the rectangle top coordinate.
+ * @param[in] width    the rectangle width.
+ * @param[in] height   the rectangle height.
+ * @return             the bit mask of overlapping areas.
+ */
+area_mask_t area_match(int x, int y, int width, int height);
+
+
+/**
+ * Registers damage for the specified areas.
+ *
+ * Every area is credited only with the damaged pixels inside it. Areas the
+ * damage only touches on their edges are not credited at all.
+ * @param[in] mask        the damaged areas (see area_match()).
+ * @param[in] x           the damaged rectangle left coordinate.
+ * @param[in] y           the damaged rectangle top coordinate.
+ * @param[in] width       the damaged rectangle width.
+ * @param[in] height      the damaged rectangle height.
+ * @param[in] timestamp   the damage timestamp.
+ * @param[in] action      the last user action timestamp or 0 outside response measurement.
+ */
+void area_register_damage(area_mask_t mask, int x, int y, int width, int height, Time timestamp, Time action);
+
+
+/**
+ * Registers damage resetting the quiet period of the specified areas.
+ *
+ * @param[in] mask   the damaged areas (see area_match()).
+ */
+void area_register_settle_damage(area_mask_t mask);
+
+
+/**
+ * Checks if all monitored areas have settled after user action.
+ *
+ * An area is settled when it has not been damaged during its quiet period.
+ * @param[in] action    the local time of the user action.
+ * @param[in] now       the current local time.
+ * @param[in] quiet     the default quiet period (msecs).
+ * @param[out] settle   the time the last area settled (the end of its quiet period).
+ * @return              true if all areas have settled.
+ */
+bool area_settled(const struct timeval* action, const struct timeval* now, unsigned int quiet, struct timeval* settle);
+
+
+/**
+ * Reports response times of the monitored areas.
+ *
+ * The response times are reported only if more than one area or a named area
+ * is monitored.
+ * @param[in] action   the user action timestamp.
+ */
+void area_response_report(Time action);
+
+
+/**
+ * Reports damage statistics of the monitored areas.
+ *
+ * The statistics are reported only if more than one area or a named area
+ * is monitored.
+ */
+void area_report();
+
+#endif
@@ -0,0 +1,224 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "compositor.h"
+#include "report.h"
+
+/**
+ * Client damage waiting for compositor frame.
+ */
+typedef struct {
+	/* the damaged rectangle in screen */
+	int x;
+	int y;
+	int width;
+	int height;
+	/* the damage timestamp */
+	Time timestamp;
+} compositor_damage_t;
+
+/**
+ * Compositing delay measurement data.
+ */
+typedef struct {
+	Display* display;
+	/* the compositing manager selection owner */
+	Window owner;
+	/* the compositor output damage object */
+	Damage damage;
+	/* the client damage waiting for compositor frame (compositor_damage_t) */
+	GQueue pending;
+	/* the user action timestamp, 0 outside response measurement */
+	Time action;
+	/* the first and last compositor output damage after user action */
+	Time first_frame;
+	Time last_frame;
+	/* the number of compositor output damage events after user action */
+	unsigned int frames;
+	/* the number of composited client damage events and their compositing delay */
+	unsigned int composited;
+	unsigned long delay_total;
+	unsigned int delay_min;
+	unsigned int delay_max;
+	/* the number of client damage events dropped from the full pending queue */
+	unsigned int dropped;
+} compositor_t;
+
+static compositor_t compositor = {
+		.display = NULL,
+		.owner = None,
+		.damage = None,
+		.pending = G_QUEUE_INIT,
+		.action = 0,
+};
+
+
+static void compositor_damage_free(compositor_damage_t* damage, void* __attribute__((unused)) data)
+{
+	g_slice_free(compositor_damage_t, damage);
+}
+
+
+/**
+ * Discards the client damage waiting for compositor frame.
+ */
+static void compositor_clear_pending()
+{
+	g_queue_foreach(&compositor.pending, (GFunc)compositor_damage_free, NULL);
+	g_queue_clear(&compositor.pending);
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool compositor_init(Display* dpy)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "_NET_WM_CM_S%d", DefaultScreen(dpy));
+	compositor.owner = XGetSelectionOwner(dpy, XInternAtom(dpy, name, False));
+	if (compositor.owner == None) return false;
+
+	compositor.display = dpy;
+	compositor.damage = XDamageCreate(dpy, DefaultRootWindow(dpy), XDamageReportRawRectangles);
+	return compositor.damage != None;
+}
+
+
+void compositor_fini()
+{
+	compositor_clear_pending();
+	if (compositor.damage) {
+		XDamageDestroy(compositor.display, compositor.damage);
+		compositor.damage = None;
+	}
+}
+
+
+bool compositor_is_damage(Damage damage)
+{
+	return compositor.damage && damage == compositor.damage;
+}
+
+
+void compositor_register_damage(int x, int y, int width, int height, Time timestamp)
+{
+	if (!compositor.damage || !compositor.action || timestamp < compositor.action) return;
+
+	if (g_queue_get_length(&compositor.pending) >= COMPOSITOR_PENDING_MAX) {
+		compositor_damage_free(g_queue_pop_head(&compositor.pending), NULL);
+		compositor.dropped++;
+	}
+	compositor_damage_t* damage = g_slice_new(compositor_damage_t);
+	damage->x = x;
+	damage->y = y;
+	damage->width = width;
+	damage->height = height;
+	damage->timestamp = timestamp;
+	g_queue_push_tail(&compositor.pending, damage);
+}
+
+
+void compositor_process_damage(XDamageNotifyEvent* dev)
+{
+	if (!compositor.action || dev->timestamp < compositor.action) return;
+
+	int x = dev->area.x, y = dev->area.y;
+	int right = x + dev->area.width, bottom = y + dev->area.height;
+	report_add_message(dev->timestamp, "Got compositor damage event %dx%d+%d+%d\n", dev->area.width,
+			dev->area.height, x, y);
+
+	/* the raw rectangles of a frame are reported with the more flag set, except the last one */
+	if (!dev->more) {
+		if (!compositor.frames++) compositor.first_frame = dev->timestamp;
+		compositor.last_frame = dev->timestamp;
+	}
+
+	/* the client damage covered by the compositor frame has been composited */
+	GList* node = compositor.pending.head;
+	while (node) {
+		GList* next = node->next;
+		compositor_damage_t* damage = node->data;
+		if (damage->timestamp <= dev->timestamp && damage->x < right && damage->x + damage->width > x &&
+				damage->y < bottom && damage->y + damage->height > y) {
+			unsigned int delay = dev->timestamp - damage->timestamp;
+			if (!compositor.composited++ || delay < compositor.delay_min) compositor.delay_min = delay;
+			if (delay > compositor.delay_max) compositor.delay_max = delay;
+			compositor.delay_total += delay;
+			compositor_damage_free(damage, NULL);
+			g_queue_delete_link(&compositor.pending, node);
+		}
+		node = next;
+	}
+}
+
+
+void compositor_start(Time action)
+{
+	if (!compositor.damage) return;
+
+	compositor_clear_pending();
+	compositor.action = action;
+	compositor.frames = 0;
+	compositor.composited = 0;
+	compositor.delay_total = 0;
+	compositor.delay_min = 0;
+	compositor.delay_max = 0;
+	compositor.dropped = 0;
+}
+
+
+void compositor_response_report()
+{
+	if (!compositor.damage || !compositor.action) return;
+
+	if (compositor.frames) {
+		report_add_message_forced("\t%32s composited: first %5ims, last %5ims, frames %u\n", "(compositor)",
+				(int)(compositor.first_frame - compositor.action), (int)(compositor.last_frame - compositor.action),
+				compositor.frames);
+	}
+	if (compositor.composited) {
+		report_add_message_forced("\t%32s compositing delay: min %ims, avg %.1fms, max %ims, "
+				"%u damage events composited, %u not composited\n", "(compositor)", compositor.delay_min,
+				(double)compositor.delay_total / compositor.composited, compositor.delay_max,
+				compositor.composited, g_queue_get_length(&compositor.pending) + compositor.dropped);
+	}
+	compositor_clear_pending();
+	compositor.action = 0;
+}
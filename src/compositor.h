@@ -0,0 +1,114 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file compositor.h
+ * Compositing delay measurement.
+ *
+ * compositor.c|h files detect the compositing manager (the _NET_WM_CM_Sn
+ * selection owner) and track its output with an additional damage object
+ * on the root window. The root window damage includes the drawing to the
+ * composite overlay window and other compositor output windows, while the
+ * redirected client windows are rendered offscreen. Every client damage
+ * after user action is correlated with the next compositor frame covering
+ * its area, giving the compositing delay of the interaction.
+ */
+
+#ifndef _COMPOSITOR_H_
+#define _COMPOSITOR_H_
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+
+/* the maximum number of client damage rectangles waiting for compositor frame */
+#define COMPOSITOR_PENDING_MAX		1024
+
+/**
+ * Initializes compositing delay measurement.
+ *
+ * @param[in] dpy   the connected display.
+ * @return          true if a compositing manager is running.
+ */
+bool compositor_init(Display* dpy);
+
+
+/**
+ * Releases resources allocated by compositing delay measurement.
+ */
+void compositor_fini();
+
+
+/**
+ * Checks if the damage object tracks the compositor output.
+ *
+ * @param[in] damage   the damage object.
+ * @return             true if the damage is compositor output damage.
+ */
+bool compositor_is_damage(Damage damage);
+
+
+/**
+ * Registers client damage waiting for compositor frame.
+ *
+ * @param[in] x           the damage left coordinate in screen.
+ * @param[in] y           the damage top coordinate in screen.
+ * @param[in] width       the damage width.
+ * @param[in] height      the damage height.
+ * @param[in] timestamp   the damage timestamp.
+ */
+void compositor_register_damage(int x, int y, int width, int height, Time timestamp);
+
+
+/**
+ * Processes compositor output damage.
+ *
+ * The client damage covered by the compositor output damage is composited.
+ * @param[in] dev   the compositor output damage event.
+ */
+void compositor_process_damage(XDamageNotifyEvent* dev);
+
+
+/**
+ * Resets the compositing statistics at the start of user action.
+ *
+ * @param[in] action   the user action timestamp.
+ */
+void compositor_start(Time action);
+
+
+/**
+ * Reports the composited frames and compositing delay after user action.
+ */
+void compositor_response_report();
+
+#endif
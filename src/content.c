@@ -0,0 +1,401 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include <glib.h>
+
+#include <X11/Xlib-xcb.h>
+#include <X11/XWDFile.h>
+#include <xcb/shm.h>
+
+#include "content.h"
+#include "report.h"
+
+/* the number of independent hash lanes */
+#define HASH_LANES		8
+
+/* the hash lane multiplier */
+#define HASH_PRIME		0x9e3779b1u
+
+/**
+ * Content hashes of a drawable.
+ */
+typedef struct {
+	/* the tile grid dimensions */
+	int columns;
+	int rows;
+	/* the tile hashes, 0 for unknown content */
+	uint64_t* hashes;
+} content_window_t;
+
+/**
+ * Content verification data.
+ */
+typedef struct {
+	/* true if damaged content verification is enabled */
+	bool verify;
+	/* the connection used for fetching content */
+	xcb_connection_t* connection;
+	/* the shared memory segment */
+	xcb_shm_seg_t segment;
+	uint8_t* data;
+	size_t size;
+	/* the root window and screen dimensions */
+	Window root;
+	int width;
+	int height;
+	/* the mapped Xvfb framebuffer file, NULL if the screen is fetched with MIT-SHM */
+	uint8_t* framebuffer;
+	size_t framebuffer_size;
+	/* the framebuffer pixels, depth and line length */
+	const uint8_t* framebuffer_pixels;
+	int framebuffer_depth;
+	int framebuffer_bytes_per_line;
+	/* the number of screen fetches read directly from the framebuffer */
+	unsigned long direct;
+	/* the content hashes of damaged drawables (content_window_t) */
+	GHashTable* windows;
+	/* the number of verified damage events */
+	unsigned long verified;
+	/* the number of damage events not changing content */
+	unsigned long noop;
+} content_t;
+
+static content_t content = {
+		.verify = false,
+		.connection = NULL,
+		.data = NULL,
+		.framebuffer = NULL,
+		.windows = NULL,
+		.direct = 0,
+		.verified = 0,
+		.noop = 0,
+};
+
+
+static void content_window_free(content_window_t* win)
+{
+	g_free(win->hashes);
+	g_slice_free(content_window_t, win);
+}
+
+
+/**
+ * Hashes a span of bytes.
+ *
+ * Every lane hashes every HASH_LANES-th word of the span. The lanes have no
+ * dependencies between each other, allowing the compiler to vectorize the loop.
+ * @param[in,out] lanes    the hash lanes.
+ * @param[in] data         the data to hash.
+ * @param[in] length       the data length (in bytes).
+ */
+static inline void hash_span(uint32_t* __restrict lanes, const uint8_t* __restrict data, int length)
+{
+	int i, j;
+	for (i = 0; i + HASH_LANES * 4 <= length; i += HASH_LANES * 4) {
+		uint32_t words[HASH_LANES];
+		memcpy(words, data + i, sizeof(words));
+		for (j = 0; j < HASH_LANES; j++) {
+			lanes[j] = (lanes[j] ^ words[j]) * HASH_PRIME;
+		}
+	}
+	for (j = 0; i < length; i++, j++) {
+		lanes[j % HASH_LANES] = (lanes[j % HASH_LANES] ^ data[i]) * HASH_PRIME;
+	}
+}
+
+
+/**
+ * Combines the hash lanes into the tile hash.
+ *
+ * @param[in] lanes   the hash lanes.
+ * @return            the tile hash, never 0.
+ */
+static uint64_t hash_finish(const uint32_t* lanes)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	int i;
+	for (i = 0; i < HASH_LANES; i++) {
+		hash = (hash ^ lanes[i]) * 0x100000001b3ULL;
+	}
+	hash ^= hash >> 29;
+	return hash ? hash : 1;
+}
+
+
+/**
+ * Retrieves the content hashes of a drawable.
+ *
+ * The hashes are reset if the drawable size has changed.
+ * @param[in] drawable   the drawable.
+ * @param[in] columns    the tile grid width.
+ * @param[in] rows       the tile grid height.
+ * @return               the drawable content hashes.
+ */
+static content_window_t* content_get_window(Window drawable, int columns, int rows)
+{
+	content_window_t* win = g_hash_table_lookup(content.windows, (gpointer)drawable);
+	if (!win) {
+		win = g_slice_new0(content_window_t);
+		g_hash_table_insert(content.windows, (gpointer)drawable, win);
+	}
+	if (win->columns != columns || win->rows != rows) {
+		g_free(win->hashes);
+		win->hashes = g_new0(uint64_t, columns * rows);
+		win->columns = columns;
+		win->rows = rows;
+	}
+	return win;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool content_init(Display* dpy, bool verify)
+{
+	content.verify |= verify;
+	if (content.data) return true;
+
+	if (!content.windows) {
+		content.root = DefaultRootWindow(dpy);
+		content.width = DisplayWidth(dpy, DefaultScreen(dpy));
+		content.height = DisplayHeight(dpy, DefaultScreen(dpy));
+		content.size = content.width * content.height * 4;
+		content.windows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL,
+				(GDestroyNotify)content_window_free);
+	}
+
+	/* the screen can be read from the mapped framebuffer without MIT-SHM */
+	xcb_connection_t* connection = XGetXCBConnection(dpy);
+	xcb_shm_query_version_reply_t* version = xcb_shm_query_version_reply(connection,
+			xcb_shm_query_version(connection), NULL);
+	if (!version) return content.framebuffer != NULL;
+	free(version);
+
+	int shmid = shmget(IPC_PRIVATE, content.size, IPC_CREAT | 0600);
+	if (shmid < 0) return content.framebuffer != NULL;
+
+	xcb_generic_error_t* error = NULL;
+	content.data = shmat(shmid, NULL, SHM_RDONLY);
+	if (content.data != (void*)-1) {
+		content.segment = xcb_generate_id(connection);
+		error = xcb_request_check(connection, xcb_shm_attach_checked(connection, content.segment, shmid, 0));
+	}
+	/* the segment is removed when both sides have detached */
+	shmctl(shmid, IPC_RMID, NULL);
+
+	if (content.data == (void*)-1 || error) {
+		free(error);
+		if (content.data != (void*)-1) shmdt(content.data);
+		content.data = NULL;
+		return content.framebuffer != NULL;
+	}
+	content.connection = connection;
+	return true;
+}
+
+
+bool content_map_framebuffer(Display* dpy, const char* filename)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return false;
+
+	struct stat st;
+	uint8_t* framebuffer = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sz_XWDheader) {
+		framebuffer = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if (framebuffer == MAP_FAILED) return false;
+
+	/* the XWD header is stored in the most significant byte first order */
+	const XWDFileHeader* header = (const XWDFileHeader*)framebuffer;
+	size_t offset = ntohl(header->header_size) + (size_t)ntohl(header->ncolors) * sz_XWDColor;
+	int width = ntohl(header->pixmap_width);
+	int height = ntohl(header->pixmap_height);
+	int bytes_per_line = ntohl(header->bytes_per_line);
+	if (ntohl(header->file_version) != XWD_FILE_VERSION || ntohl(header->pixmap_format) != ZPixmap ||
+			ntohl(header->bits_per_pixel) != 32 || width != DisplayWidth(dpy, DefaultScreen(dpy)) ||
+			height != DisplayHeight(dpy, DefaultScreen(dpy)) || bytes_per_line < width * 4 ||
+			offset + (size_t)bytes_per_line * height > (size_t)st.st_size) {
+		munmap(framebuffer, st.st_size);
+		return false;
+	}
+	if (content.framebuffer) munmap(content.framebuffer, content.framebuffer_size);
+	content.framebuffer = framebuffer;
+	content.framebuffer_size = st.st_size;
+	content.framebuffer_pixels = framebuffer + offset;
+	content.framebuffer_depth = ntohl(header->pixmap_depth);
+	content.framebuffer_bytes_per_line = bytes_per_line;
+	return content_init(dpy, false);
+}
+
+
+void content_fini()
+{
+	content.verify = false;
+	if (content.data) {
+		xcb_shm_detach(content.connection, content.segment);
+		xcb_flush(content.connection);
+		shmdt(content.data);
+		content.data = NULL;
+	}
+	if (content.framebuffer) {
+		munmap(content.framebuffer, content.framebuffer_size);
+		content.framebuffer = NULL;
+	}
+	if (content.windows) {
+		g_hash_table_destroy(content.windows);
+		content.windows = NULL;
+	}
+	content.direct = 0;
+	content.verified = 0;
+	content.noop = 0;
+}
+
+
+const uint8_t* content_fetch(Window drawable, int x, int y, int width, int height, int* depth, int* bytes_per_line)
+{
+	/* the screen content is read from the mapped framebuffer without any requests */
+	if (content.framebuffer && drawable == content.root) {
+		if (x < 0 || y < 0 || x + width > content.width || y + height > content.height) return NULL;
+		content.direct++;
+		*depth = content.framebuffer_depth;
+		*bytes_per_line = content.framebuffer_bytes_per_line;
+		return content.framebuffer_pixels + y * content.framebuffer_bytes_per_line + x * 4;
+	}
+
+	if (!content.data || (size_t)width * height * 4 > content.size) return NULL;
+
+	xcb_generic_error_t* error = NULL;
+	xcb_shm_get_image_reply_t* reply = xcb_shm_get_image_reply(content.connection,
+			xcb_shm_get_image(content.connection, drawable, x, y, width, height, ~0,
+					XCB_IMAGE_FORMAT_Z_PIXMAP, content.segment, 0), &error);
+	if (!reply) {
+		/* the window is not viewable or was destroyed */
+		free(error);
+		return NULL;
+	}
+	*depth = reply->depth;
+	*bytes_per_line = reply->size / height;
+	free(reply);
+	return content.data;
+}
+
+
+bool content_changed(XDamageNotifyEvent* dev)
+{
+	if (!content.verify) return true;
+
+	Window drawable = dev->drawable;
+	int x = dev->area.x, y = dev->area.y;
+	int width = dev->geometry.width, height = dev->geometry.height;
+	int right, bottom;
+	right = MIN(x + dev->area.width, width);
+	bottom = MIN(y + dev->area.height, height);
+	x = MAX(x, 0);
+	y = MAX(y, 0);
+	if (x >= right || y >= bottom) return true;
+
+	/* fetch the tiles covering the damaged area */
+	int column_start = x / CONTENT_TILE_SIZE, column_end = (right - 1) / CONTENT_TILE_SIZE;
+	int row_start = y / CONTENT_TILE_SIZE, row_end = (bottom - 1) / CONTENT_TILE_SIZE;
+	int fetch_x = column_start * CONTENT_TILE_SIZE;
+	int fetch_y = row_start * CONTENT_TILE_SIZE;
+	int fetch_width = MIN((column_end + 1) * CONTENT_TILE_SIZE, width) - fetch_x;
+	int fetch_height = MIN((row_end + 1) * CONTENT_TILE_SIZE, height) - fetch_y;
+	int depth, bytes_per_line;
+	const uint8_t* pixels = content_fetch(drawable, fetch_x, fetch_y, fetch_width, fetch_height, &depth, &bytes_per_line);
+	if (!pixels || depth < 8) return true;
+	int bytes_per_pixel = depth > 16 ? 4 : depth > 8 ? 2 : 1;
+
+	content.verified++;
+	content_window_t* win = content_get_window(drawable, (width + CONTENT_TILE_SIZE - 1) / CONTENT_TILE_SIZE,
+			(height + CONTENT_TILE_SIZE - 1) / CONTENT_TILE_SIZE);
+	bool changed = false;
+	int row, column, line;
+	for (row = row_start; row <= row_end; row++) {
+		int tile_y = row * CONTENT_TILE_SIZE - fetch_y;
+		int tile_height = MIN(CONTENT_TILE_SIZE, fetch_height - tile_y);
+		for (column = column_start; column <= column_end; column++) {
+			int tile_x = column * CONTENT_TILE_SIZE - fetch_x;
+			int tile_width = MIN(CONTENT_TILE_SIZE, fetch_width - tile_x);
+			uint32_t lanes[HASH_LANES] = {1, 2, 3, 4, 5, 6, 7, 8};
+
+			const uint8_t* data = pixels + tile_y * bytes_per_line + tile_x * bytes_per_pixel;
+			for (line = 0; line < tile_height; line++) {
+				hash_span(lanes, data, tile_width * bytes_per_pixel);
+				data += bytes_per_line;
+			}
+			uint64_t hash = hash_finish(lanes);
+			uint64_t* stored = &win->hashes[row * win->columns + column];
+			if (*stored != hash) {
+				*stored = hash;
+				changed = true;
+			}
+		}
+	}
+	if (!changed) content.noop++;
+	return changed;
+}
+
+
+void content_remove_window(Window window)
+{
+	if (content.windows) g_hash_table_remove(content.windows, (gpointer)window);
+}
+
+
+void content_report()
+{
+	if (content.direct) {
+		report_add_message_forced("Framebuffer: %lu screen fetches read directly from the mapped framebuffer\n",
+				content.direct);
+	}
+	if (!content.verify || !content.verified) return;
+
+	report_add_message_forced("Content verification: %lu damage events verified, %lu (%.1f%%) did not change content\n\n",
+			content.verified, content.noop, content.noop * 100.0 / content.verified);
+}
@@ -0,0 +1,135 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file content.h
+ * Damaged content verification.
+ *
+ * content.c|h files verify if the damaged content has really changed. The
+ * damaged area is fetched through MIT-SHM into a shared memory segment
+ * allocated once at initialization and hashed in fixed size tiles. Damage
+ * not changing any tile hash is a no-op repaint of identical content.
+ * The shared memory segment is also used to fetch screen content for
+ * other content checks. When running under Xvfb with -fbdir option, the
+ * screen framebuffer file can be mapped instead, so screen content is read
+ * without any X requests.
+ */
+
+#ifndef _CONTENT_H_
+#define _CONTENT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+
+/* the content hash tile size (in pixels) */
+#define CONTENT_TILE_SIZE	32
+
+/**
+ * Initializes content fetching and optionally damaged content verification.
+ *
+ * Can be called several times, the shared memory segment is attached only once.
+ * @param[in] dpy      the connected display.
+ * @param[in] verify   true to enable damaged content verification.
+ * @return             true if the MIT-SHM extension is supported and the shared
+ *                     memory segment was attached.
+ */
+bool content_init(Display* dpy, bool verify);
+
+
+/**
+ * Maps Xvfb screen framebuffer file.
+ *
+ * The screen content is read directly from the mapped framebuffer instead of
+ * fetching it with MIT-SHM. The framebuffer must be in 32 bit per pixel format.
+ * Note that the framebuffer contains the software cursor.
+ * @param[in] dpy        the connected display.
+ * @param[in] filename   the framebuffer file (Xvfb_screen<N> in the -fbdir directory).
+ * @return               true if the framebuffer file was mapped.
+ */
+bool content_map_framebuffer(Display* dpy, const char* filename);
+
+
+/**
+ * Fetches drawable content into the shared memory segment.
+ *
+ * The content is fetched in ZPixmap format. It's valid until the next fetch.
+ * The root window content is returned directly from the framebuffer if it
+ * was mapped with content_map_framebuffer().
+ * @param[in] drawable          the drawable.
+ * @param[in] x                 the left coordinate of the fetched rectangle.
+ * @param[in] y                 the top coordinate of the fetched rectangle.
+ * @param[in] width             the rectangle width.
+ * @param[in] height            the rectangle height.
+ * @param[out] depth            the drawable depth.
+ * @param[out] bytes_per_line   the number of bytes per fetched line.
+ * @return                      the fetched content (the top left pixel of the rectangle)
+ *                              or NULL if the content can't be fetched.
+ */
+const uint8_t* content_fetch(Window drawable, int x, int y, int width, int height, int* depth, int* bytes_per_line);
+
+
+/**
+ * Releases resources allocated by damaged content verification.
+ */
+void content_fini();
+
+
+/**
+ * Checks if the damage changed the content of the damaged drawable.
+ *
+ * The content of the root window damage is fetched from the screen, as it
+ * contains the composited output, and the content of other damage from the
+ * damaged window. Damage of content that can't be fetched is considered
+ * as changed.
+ * @param[in] dev   the damage event.
+ * @return          true if the content has changed or content verification
+ *                  is not enabled.
+ */
+bool content_changed(XDamageNotifyEvent* dev);
+
+
+/**
+ * Removes the content hashes of a destroyed window.
+ *
+ * @param[in] window   the destroyed window.
+ */
+void content_remove_window(Window window);
+
+
+/**
+ * Reports the number of verified and no-op damage events.
+ */
+void content_report();
+
+#endif
@@ -0,0 +1,292 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <glib.h>
+
+#include <X11/Xlib.h>
+
+#include "control.h"
+#include "xresponse.h"
+#include "xhandler.h"
+#include "wincache.h"
+
+/* the time to wait for the session command line (secs) */
+#define CONTROL_READ_TIMEOUT	5
+
+/**
+ * Control socket data.
+ */
+typedef struct {
+	/* the listening socket */
+	int fd;
+	/* the socket path */
+	char* path;
+	/* the connected session client, -1 if no session is active */
+	int client;
+	/* the saved standard output and error */
+	int stdout_fd;
+	int stderr_fd;
+} control_t;
+
+static control_t control = {
+		.fd = -1,
+		.path = NULL,
+		.client = -1,
+		.stdout_fd = -1,
+		.stderr_fd = -1,
+};
+
+
+/**
+ * Processes the queued X events while waiting for clients.
+ *
+ * Only the window cache is updated, the other events (for example damage
+ * of the windows monitored by the previous session) are dropped.
+ */
+static void process_events()
+{
+	XEvent ev;
+	struct timeval tv = { 0, 0 };
+
+	while (xhandler_get_xevent_timed(&ev, &tv)) {
+		wincache_process_event(&ev);
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+	}
+}
+
+
+/**
+ * Reads the session command line from the client.
+ *
+ * @param[in] fd        the client socket.
+ * @param[out] command  the command line buffer of CONTROL_COMMAND_MAX bytes.
+ * @return              true if the command line was read.
+ */
+static bool read_command(int fd, char* command)
+{
+	size_t length = 0;
+	char* eol;
+
+	while (length < CONTROL_COMMAND_MAX - 1) {
+		ssize_t n = read(fd, command + length, CONTROL_COMMAND_MAX - 1 - length);
+		if (n <= 0) break;
+
+		length += n;
+		command[length] = '\0';
+		if ((eol = strchr(command, '\n'))) {
+			*eol = '\0';
+			return true;
+		}
+	}
+	command[length] = '\0';
+	/* the command line can be also terminated by shutting down the writing side */
+	return length > 0 && length < CONTROL_COMMAND_MAX - 1;
+}
+
+
+/**
+ * Parses the session command line.
+ *
+ * @param[in] client     the client socket, used to report errors.
+ * @param[in] progname   the program name.
+ * @param[in] command    the command line.
+ * @param[out] argc      the number of arguments.
+ * @param[out] argv      the arguments.
+ * @return               true if the command line was parsed.
+ */
+static bool parse_command(int client, const char* progname, const char* command, int* argc, char*** argv)
+{
+	GError* error = NULL;
+	char* quoted = g_shell_quote(progname);
+	char* line = g_strconcat(quoted, " ", command, NULL);
+	bool rc = g_shell_parse_argv(line, argc, argv, &error);
+
+	if (!rc) {
+		dprintf(client, "*** failed to parse session command line: %s\n", error->message);
+		g_error_free(error);
+	}
+	g_free(line);
+	g_free(quoted);
+	return rc;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool control_init(const char* path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	struct stat st;
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Control socket path is too long: %s\n", path);
+		return false;
+	}
+	strcpy(addr.sun_path, path);
+
+	if ((control.fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		fprintf(stderr, "Failed to create control socket (%s)\n", strerror(errno));
+		return false;
+	}
+	/* replace the socket left by a previous daemon, but not other files */
+	if (!stat(path, &st) && S_ISSOCK(st.st_mode)) {
+		unlink(path);
+	}
+	/* the clients can inject input and write files, so only the owner can connect */
+	mode_t mask = umask(077);
+	int rc = bind(control.fd, (struct sockaddr*)&addr, sizeof(addr));
+	umask(mask);
+	if (rc < 0 || listen(control.fd, SOMAXCONN) < 0) {
+		fprintf(stderr, "Failed to listen on control socket %s (%s)\n", path, strerror(errno));
+		close(control.fd);
+		control.fd = -1;
+		return false;
+	}
+	control.path = g_strdup(path);
+	control.stdout_fd = dup(STDOUT_FILENO);
+	control.stderr_fd = dup(STDERR_FILENO);
+	return true;
+}
+
+
+void control_fini()
+{
+	control_close();
+	if (control.fd >= 0) {
+		close(control.fd);
+		control.fd = -1;
+		unlink(control.path);
+		g_free(control.path);
+		control.path = NULL;
+		close(control.stdout_fd);
+		close(control.stderr_fd);
+	}
+}
+
+
+bool control_accept(const char* progname, int* argc, char*** argv)
+{
+	char command[CONTROL_COMMAND_MAX];
+	int fd = ConnectionNumber(xhandler.display);
+
+	sigset_t interrupt, mask;
+	sigemptyset(&interrupt);
+	sigaddset(&interrupt, SIGINT);
+
+	while (true) {
+		process_events();
+
+		fd_set readset;
+		FD_ZERO(&readset);
+		FD_SET(fd, &readset);
+		FD_SET(control.fd, &readset);
+
+		/* the interrupt is unblocked only while waiting, so it can't be missed
+		 * between checking the abort flag and starting the wait */
+		sigprocmask(SIG_BLOCK, &interrupt, &mask);
+		if (options.abort_wait) {
+			sigprocmask(SIG_SETMASK, &mask, NULL);
+			return false;
+		}
+		int rc = pselect(MAX(fd, control.fd) + 1, &readset, NULL, NULL, NULL, &mask);
+		sigprocmask(SIG_SETMASK, &mask, NULL);
+		if (rc < 0) {
+			if (errno == EINTR) continue;
+			fprintf(stderr, "Failed to wait for control socket clients (%s)\n", strerror(errno));
+			return false;
+		}
+		if (!FD_ISSET(control.fd, &readset)) continue;
+
+		int client = accept(control.fd, NULL, NULL);
+		if (client < 0) continue;
+
+		struct ucred cred;
+		socklen_t length = sizeof(cred);
+		if (getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &length) < 0 || cred.uid != getuid()) {
+			fprintf(stderr, "Rejected control socket client of another user\n");
+			close(client);
+			continue;
+		}
+
+		/* don't let a stalled client block the daemon */
+		struct timeval timeout = { CONTROL_READ_TIMEOUT, 0 };
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		if (!read_command(client, command)) {
+			dprintf(client, "*** failed to read session command line\n");
+			close(client);
+			continue;
+		}
+		if (!parse_command(client, progname, command, argc, argv)) {
+			close(client);
+			continue;
+		}
+
+		/* stream the session output to the client */
+		fflush(stdout);
+		fflush(stderr);
+		dup2(client, STDOUT_FILENO);
+		dup2(client, STDERR_FILENO);
+		control.client = client;
+		return true;
+	}
+}
+
+
+void control_close()
+{
+	if (control.client < 0) return;
+
+	fflush(stdout);
+	fflush(stderr);
+	dup2(control.stdout_fd, STDOUT_FILENO);
+	dup2(control.stderr_fd, STDERR_FILENO);
+	close(control.client);
+	control.client = -1;
+}
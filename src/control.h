@@ -0,0 +1,93 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file control.h
+ * Local control socket for daemon mode.
+ *
+ * control.c|h files implement the Unix domain socket used to receive
+ * measurement sessions in daemon mode. A client connects to the socket and
+ * writes the session command line - the same options as accepted by
+ * xresponse, shell quoted and terminated by a newline. The standard output
+ * and error are redirected to the client for the session duration, so the
+ * report is streamed back as it is written. The session ends by closing the
+ * connection. The socket is accessible only by its owner and clients of
+ * other users are rejected.
+ *
+ * While waiting for clients the X events are still processed, keeping the
+ * window tree mirror up to date for the next session.
+ */
+
+#ifndef _CONTROL_H_
+#define _CONTROL_H_
+
+#include <stdbool.h>
+
+/* the maximum length of the session command line */
+#define CONTROL_COMMAND_MAX	4096
+
+/**
+ * Creates the control socket and starts listening for clients.
+ *
+ * @param[in] path   the socket path. An existing socket file is replaced.
+ * @return           true if the socket was created.
+ */
+bool control_init(const char* path);
+
+
+/**
+ * Closes the control socket and removes the socket file.
+ */
+void control_fini();
+
+
+/**
+ * Waits for the next measurement session.
+ *
+ * The standard output and error are redirected to the accepted client
+ * until control_close() is called.
+ * @param[in] progname   the program name, used as the first session argument.
+ * @param[out] argc      the number of session arguments.
+ * @param[out] argv      the session arguments. Must be released with g_strfreev().
+ * @return               true if a session was accepted, false if waiting
+ *                       was aborted.
+ */
+bool control_accept(const char* progname, int* argc, char*** argv);
+
+
+/**
+ * Ends the current measurement session.
+ *
+ * Restores the standard output and error and closes the client connection.
+ */
+void control_close();
+
+#endif
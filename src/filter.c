@@ -0,0 +1,406 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "filter.h"
+#include "application.h"
+#include "report.h"
+
+/**
+ * Damage event fields used by filtering rules.
+ */
+enum {
+	FIELD_WIDTH,
+	FIELD_HEIGHT,
+	FIELD_AREA,
+	/* width / height * 1000 */
+	FIELD_ASPECT,
+	FIELD_X,
+	FIELD_Y,
+	FIELD_RIGHT,
+	FIELD_BOTTOM,
+	FIELD_WINDOW,
+	/* window damage events per second */
+	FIELD_RATE,
+	/* interned application name */
+	FIELD_APP,
+	FIELD_COUNT
+};
+
+/* comparison result bits, an instruction matches if the comparison
+ * result bit is set in its comparison mask */
+#define CMP_LESS	1
+#define CMP_EQUAL	2
+#define CMP_GREATER	4
+
+/**
+ * Filter instruction - compares damage event field with a value.
+ */
+typedef struct {
+	/* the field to compare */
+	int field;
+	/* the comparison mask (CMP_* bits) */
+	int cmp;
+	/* the value to compare with */
+	int64_t value;
+} instruction_t;
+
+
+/**
+ * Filter rule.
+ */
+typedef struct {
+	/* the rule text for reporting */
+	char* text;
+	/* the rule type (FILTER_RULE_*) */
+	int type;
+	/* the first rule instruction index */
+	int first;
+	/* the number of rule instructions */
+	int count;
+	/* number of matched damage events */
+	unsigned long hits;
+} rule_t;
+
+
+/**
+ * Damage filter data.
+ */
+typedef struct {
+	/* the rule instructions */
+	GArray* program;
+	/* the rules */
+	GArray* rules;
+	/* the number of include rules */
+	int includes;
+	/* true if any rule checks application name */
+	bool use_app;
+} filter_t;
+
+static filter_t filter = {
+		.program = NULL,
+		.rules = NULL,
+		.includes = 0,
+		.use_app = false,
+};
+
+
+/**
+ * Field names, indexed by field id.
+ */
+static const char* field_names[FIELD_COUNT] = {
+		[FIELD_WIDTH] = "width",
+		[FIELD_HEIGHT] = "height",
+		[FIELD_AREA] = "area",
+		[FIELD_ASPECT] = "aspect",
+		[FIELD_X] = "x",
+		[FIELD_Y] = "y",
+		[FIELD_RIGHT] = NULL,
+		[FIELD_BOTTOM] = NULL,
+		[FIELD_WINDOW] = "window",
+		[FIELD_RATE] = "rate",
+		[FIELD_APP] = "app",
+};
+
+
+/**
+ * Adds instruction to the filter program.
+ */
+static void add_instruction(int field, int cmp, int64_t value)
+{
+	instruction_t ins = {.field = field, .cmp = cmp, .value = value};
+	g_array_append_val(filter.program, ins);
+}
+
+
+/**
+ * Adds rule consisting of the instructions added since the first instruction.
+ */
+static void add_rule(const char* text, int type, int first)
+{
+	rule_t rule = {
+			.text = g_strdup(text),
+			.type = type,
+			.first = first,
+			.count = filter.program->len - first,
+			.hits = 0,
+	};
+	g_array_append_val(filter.rules, rule);
+	if (type == FILTER_RULE_INCLUDE) filter.includes++;
+}
+
+
+/**
+ * Parses comparison operator.
+ *
+ * @param[in] op    the operator text.
+ * @param[out] cmp  the comparison mask.
+ * @return          the operator length or 0 if the operator was not recognized.
+ */
+static int parse_operator(const char* op, int* cmp)
+{
+	if (!strncmp(op, "<=", 2)) { *cmp = CMP_LESS | CMP_EQUAL; return 2; }
+	if (!strncmp(op, ">=", 2)) { *cmp = CMP_GREATER | CMP_EQUAL; return 2; }
+	if (!strncmp(op, "!=", 2)) { *cmp = CMP_LESS | CMP_GREATER; return 2; }
+	if (*op == '<') { *cmp = CMP_LESS; return 1; }
+	if (*op == '>') { *cmp = CMP_GREATER; return 1; }
+	if (*op == '=') { *cmp = CMP_EQUAL; return 1; }
+	return 0;
+}
+
+
+/**
+ * Parses the legacy XxY[,less|greater] and S[,less|greater] rules.
+ *
+ * The edge size rule matches if either edge matches, so it's split into
+ * two rules.
+ * @return  true if the text was a legacy rule.
+ */
+static bool parse_legacy_rule(const char* text, int type)
+{
+	unsigned int width, height, size;
+	char rules[32] = "";
+	char label[256];
+	int first = filter.program->len;
+
+	if (sscanf(text, "%ux%u,%31s", &width, &height, rules) >= 2) {
+		int cmp = strcmp(rules, "greater") ? CMP_LESS | CMP_EQUAL : CMP_GREATER;
+		if (*rules && strcmp(rules, "less") && strcmp(rules, "greater")) return false;
+
+		snprintf(label, sizeof(label), "%s [width]", text);
+		add_instruction(FIELD_WIDTH, cmp, width);
+		add_rule(label, type, first);
+
+		snprintf(label, sizeof(label), "%s [height]", text);
+		first = filter.program->len;
+		add_instruction(FIELD_HEIGHT, cmp, height);
+		add_rule(label, type, first);
+		return true;
+	}
+	if (sscanf(text, "%u,%31s", &size, rules) >= 1 && strchr("0123456789", *text)) {
+		int cmp = strcmp(rules, "greater") ? CMP_LESS | CMP_EQUAL : CMP_GREATER;
+		if (*rules && strcmp(rules, "less") && strcmp(rules, "greater")) return false;
+		/* reject the new style rules starting with a number */
+		if (strspn(text, "0123456789") != strcspn(text, ",")) return false;
+
+		add_instruction(FIELD_AREA, cmp, size);
+		add_rule(text, type, first);
+		return true;
+	}
+	return false;
+}
+
+
+/**
+ * Parses single rule condition and adds its instructions to the program.
+ *
+ * @return  true if the condition was parsed successfully.
+ */
+static bool parse_condition(const char* cond)
+{
+	int field, cmp, len;
+	int klen = strspn(cond, "abcdefghijklmnopqrstuvwxyz");
+	const char* value;
+
+	if (!klen || !(len = parse_operator(cond + klen, &cmp))) return false;
+	value = cond + klen + len;
+
+	if (klen == 2 && !strncmp(cond, "in", 2)) {
+		Rectangle rect;
+		if (cmp != CMP_EQUAL || sscanf(value, "%dx%d+%d+%d", &rect.width, &rect.height, &rect.x, &rect.y) != 4)
+			return false;
+		add_instruction(FIELD_X, CMP_GREATER | CMP_EQUAL, rect.x);
+		add_instruction(FIELD_Y, CMP_GREATER | CMP_EQUAL, rect.y);
+		add_instruction(FIELD_RIGHT, CMP_LESS | CMP_EQUAL, rect.x + rect.width);
+		add_instruction(FIELD_BOTTOM, CMP_LESS | CMP_EQUAL, rect.y + rect.height);
+		return true;
+	}
+
+	for (field = 0; field < FIELD_COUNT; field++) {
+		if (field_names[field] && strlen(field_names[field]) == klen && !strncmp(cond, field_names[field], klen))
+			break;
+	}
+	if (field == FIELD_COUNT || !*value) return false;
+
+	if (field == FIELD_APP) {
+		if (cmp != CMP_EQUAL && cmp != (CMP_LESS | CMP_GREATER)) return false;
+		add_instruction(field, cmp, (int64_t)(intptr_t)g_intern_string(value));
+		filter.use_app = true;
+		return true;
+	}
+
+	char* end;
+	int64_t number;
+	if (field == FIELD_ASPECT) {
+		number = strtod(value, &end) * 1000;
+	}
+	else {
+		number = strtoll(value, &end, 0);
+	}
+	if (*end) return false;
+
+	add_instruction(field, cmp, number);
+	return true;
+}
+
+
+/**
+ * Evaluates rule instructions for the damage event fields.
+ *
+ * @return  true if all rule instructions matched.
+ */
+static inline bool rule_match(const rule_t* rule, const int64_t* fields)
+{
+	const instruction_t* ins = &g_array_index(filter.program, instruction_t, rule->first);
+	const instruction_t* end = ins + rule->count;
+	int match = 1;
+
+	for (; ins < end; ins++) {
+		int64_t field = fields[ins->field];
+		int result = (field < ins->value) * CMP_LESS | (field == ins->value) * CMP_EQUAL |
+				(field > ins->value) * CMP_GREATER;
+		match &= (result & ins->cmp) != 0;
+	}
+	return match;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool filter_add(const char* text, int type)
+{
+	if (!filter.program) {
+		filter.program = g_array_new(FALSE, FALSE, sizeof(instruction_t));
+		filter.rules = g_array_new(FALSE, FALSE, sizeof(rule_t));
+	}
+
+	int first = filter.program->len;
+	if (parse_legacy_rule(text, type)) return true;
+
+	char** conds = g_strsplit(text, ",", 0);
+	char** cond;
+	bool rc = true;
+
+	for (cond = conds; *cond && rc; cond++) {
+		rc = parse_condition(*cond);
+	}
+	g_strfreev(conds);
+
+	if (!rc || first == filter.program->len) {
+		g_array_set_size(filter.program, first);
+		return false;
+	}
+	add_rule(text, type, first);
+	return true;
+}
+
+
+void filter_fini()
+{
+	if (filter.rules) {
+		int i;
+		for (i = 0; i < filter.rules->len; i++) {
+			g_free(g_array_index(filter.rules, rule_t, i).text);
+		}
+		g_array_free(filter.rules, TRUE);
+		g_array_free(filter.program, TRUE);
+		filter.rules = NULL;
+		filter.program = NULL;
+	}
+	filter.includes = 0;
+	filter.use_app = false;
+}
+
+
+bool filter_exclude(XDamageNotifyEvent* dev, window_t* win, int x, int y, bool* ignored)
+{
+	*ignored = false;
+	if (!filter.rules) return false;
+
+	int64_t fields[FIELD_COUNT] = {
+			[FIELD_WIDTH] = dev->area.width,
+			[FIELD_HEIGHT] = dev->area.height,
+			[FIELD_AREA] = dev->area.width * dev->area.height,
+			[FIELD_ASPECT] = dev->area.height ? dev->area.width * 1000 / dev->area.height : INT64_MAX,
+			[FIELD_X] = x,
+			[FIELD_Y] = y,
+			[FIELD_RIGHT] = x + dev->area.width,
+			[FIELD_BOTTOM] = y + dev->area.height,
+			[FIELD_WINDOW] = dev->drawable,
+			[FIELD_RATE] = win ? window_get_damage_rate(win) : 0,
+			[FIELD_APP] = 0,
+	};
+	if (filter.use_app && win && win->application) {
+		fields[FIELD_APP] = (int64_t)(intptr_t)win->application->interned_name;
+	}
+
+	rule_t* rule = (rule_t*)filter.rules->data;
+	rule_t* end = rule + filter.rules->len;
+	int excluded = 0, included = 0, ignore = 0;
+
+	for (; rule < end; rule++) {
+		int match = rule_match(rule, fields);
+		rule->hits += match;
+		included |= match & (rule->type == FILTER_RULE_INCLUDE);
+		excluded |= match & (rule->type == FILTER_RULE_EXCLUDE);
+		ignore |= match & (rule->type == FILTER_RULE_IGNORE);
+	}
+	*ignored = ignore;
+	return excluded || (filter.includes && !included);
+}
+
+
+void filter_report()
+{
+	if (!filter.rules) return;
+
+	static const char* type_names[] = {
+			[FILTER_RULE_EXCLUDE] = "exclude",
+			[FILTER_RULE_INCLUDE] = "include",
+			[FILTER_RULE_IGNORE] = "ignore",
+	};
+	int i;
+	report_add_message_forced("Damage filter rule hits:\n");
+	for (i = 0; i < filter.rules->len; i++) {
+		rule_t* rule = &g_array_index(filter.rules, rule_t, i);
+		report_add_message_forced("\t%s %-40s %lu\n", type_names[rule->type], rule->text, rule->hits);
+	}
+	report_add_message_forced("\n");
+}
@@ -0,0 +1,109 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file filter.h
+ * Damage event filtering.
+ *
+ * filter.c|h files implement damage filtering rules specified with --exclude
+ * and --include options. A rule is a comma separated list of conditions which
+ * all must match for the rule to match:
+ *   <key><op><value>   where key is width, height, area, aspect (width/height),
+ *                      x, y, window, rate (window damage events per second) or
+ *                      app; op is one of <, <=, >, >=, =, !=.
+ *   in=WxH+X+Y         the damage is inside the specified rectangle.
+ *   XxY[,less|greater] legacy edge size rule (either edge less or equal/greater).
+ *   S[,less|greater]   legacy area size rule.
+ *
+ * A damage event is filtered out if it matches any exclude rule, or if
+ * include rules are specified and it does not match any of them. Damage
+ * matching ignore rules (--settle-ignore option) is reported, but does not
+ * delay the response settling.
+ *
+ * The rules are compiled into a flat array of comparison instructions
+ * evaluated without branching on the rule contents. Every rule counts
+ * the number of damage events it matched.
+ */
+
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+
+#include "window.h"
+
+/**
+ * Filter rule types.
+ */
+enum {
+	FILTER_RULE_EXCLUDE,
+	FILTER_RULE_INCLUDE,
+	FILTER_RULE_IGNORE,
+};
+
+/**
+ * Adds damage filtering rule.
+ *
+ * @param[in] text      the rule text.
+ * @param[in] type      the rule type (FILTER_RULE_*).
+ * @return              true if the rule was parsed successfully.
+ */
+bool filter_add(const char* text, int type);
+
+
+/**
+ * Releases resources allocated by damage filter.
+ */
+void filter_fini();
+
+
+/**
+ * Checks if the damage event must be filtered out.
+ *
+ * @param[in] dev    the damage event.
+ * @param[in] win    the damaged window (can be NULL).
+ * @param[in] x      the damage left coordinate in screen.
+ * @param[in] y      the damage top coordinate in screen.
+ * @param[out] ignored   true if the damage event matches an ignore rule.
+ * @return           true if the damage event must be filtered out.
+ */
+bool filter_exclude(XDamageNotifyEvent* dev, window_t* win, int x, int y, bool* ignored);
+
+
+/**
+ * Reports the number of damage events matched by every rule.
+ */
+void filter_report();
+
+#endif
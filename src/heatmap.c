@@ -0,0 +1,169 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "heatmap.h"
+
+/**
+ * Heatmap data structure.
+ */
+typedef struct {
+	/* the output file name */
+	char* filename;
+	/* the screen dimensions */
+	int width;
+	int height;
+	/* the cell size */
+	int cell_size;
+	/* the grid dimensions (in cells) */
+	int columns;
+	int rows;
+	/* the damage counters, rows * columns */
+	uint32_t* cells;
+} heatmap_t;
+
+static heatmap_t heatmap = {
+		.filename = NULL,
+		.cells = NULL,
+};
+
+
+/**
+ * Increments a span of counters.
+ *
+ * The loop has no dependencies between iterations, allowing the compiler
+ * to vectorize it.
+ * @param[in] row     the first counter.
+ * @param[in] count   the number of counters to increment.
+ */
+static inline void increment_span(uint32_t* __restrict row, int count)
+{
+	int i;
+	for (i = 0; i < count; i++) {
+		row[i]++;
+	}
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool heatmap_init(const char* filename, int width, int height, int cell_size)
+{
+	if (cell_size <= 0 || width <= 0 || height <= 0) return false;
+
+	heatmap.width = width;
+	heatmap.height = height;
+	heatmap.cell_size = cell_size;
+	heatmap.columns = (width + cell_size - 1) / cell_size;
+	heatmap.rows = (height + cell_size - 1) / cell_size;
+
+	g_free(heatmap.cells);
+	heatmap.cells = g_malloc0(sizeof(uint32_t) * heatmap.columns * heatmap.rows);
+
+	g_free(heatmap.filename);
+	heatmap.filename = g_strdup(filename);
+	return true;
+}
+
+
+void heatmap_fini()
+{
+	g_free(heatmap.cells);
+	heatmap.cells = NULL;
+	g_free(heatmap.filename);
+	heatmap.filename = NULL;
+}
+
+
+void heatmap_add(int x, int y, int width, int height)
+{
+	if (!heatmap.cells) return;
+
+	int x2 = x + width;
+	int y2 = y + height;
+
+	/* clip the area to screen */
+	if (x < 0) x = 0;
+	if (y < 0) y = 0;
+	if (x2 > heatmap.width) x2 = heatmap.width;
+	if (y2 > heatmap.height) y2 = heatmap.height;
+	if (x >= x2 || y >= y2) return;
+
+	int column = x / heatmap.cell_size;
+	int span = (x2 - 1) / heatmap.cell_size - column + 1;
+	int row_end = (y2 - 1) / heatmap.cell_size;
+	int row;
+
+	for (row = y / heatmap.cell_size; row <= row_end; row++) {
+		increment_span(heatmap.cells + row * heatmap.columns + column, span);
+	}
+}
+
+
+bool heatmap_write()
+{
+	if (!heatmap.cells) return false;
+
+	FILE* fp = fopen(heatmap.filename, "wb");
+	if (!fp) {
+		fprintf(stderr, "Error while creating heatmap file %s (%s)\n", heatmap.filename, strerror(errno));
+		return false;
+	}
+
+	int size = heatmap.columns * heatmap.rows;
+	uint32_t max = 0;
+	int i;
+
+	for (i = 0; i < size; i++) {
+		if (heatmap.cells[i] > max) max = heatmap.cells[i];
+	}
+
+	fprintf(fp, "P5\n# xresponse damage heatmap, %dx%d cells, max %u damages per cell\n%d %d\n65535\n",
+			heatmap.cell_size, heatmap.cell_size, max, heatmap.columns, heatmap.rows);
+
+	for (i = 0; i < size; i++) {
+		unsigned int value = max ? (unsigned int)((uint64_t)heatmap.cells[i] * 65535 / max) : 0;
+		fputc(value >> 8, fp);
+		fputc(value & 0xff, fp);
+	}
+	fclose(fp);
+	return true;
+}
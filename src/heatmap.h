@@ -0,0 +1,89 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file heatmap.h
+ * Damage heatmap accumulation.
+ *
+ * heatmap.c|h files accumulate damaged areas into a coarse screen grid of
+ * counters and write the grid as a grayscale PGM image at exit. The grid is
+ * allocated once during initialization, so damage accumulation does not
+ * allocate memory.
+ */
+
+#ifndef _HEATMAP_H_
+#define _HEATMAP_H_
+
+#include <stdbool.h>
+
+/* the default heatmap cell size (in pixels) */
+#define HEATMAP_DEFAULT_CELL_SIZE	8
+
+/**
+ * Initializes the damage heatmap.
+ *
+ * @param[in] filename    the output image file name.
+ * @param[in] width       the screen width.
+ * @param[in] height      the screen height.
+ * @param[in] cell_size   the grid cell size (in pixels).
+ * @return                true if the heatmap was initialized successfully.
+ */
+bool heatmap_init(const char* filename, int width, int height, int cell_size);
+
+
+/**
+ * Releases resources allocated by the damage heatmap.
+ */
+void heatmap_fini();
+
+
+/**
+ * Accumulates damaged area into the heatmap.
+ *
+ * The area is specified in screen coordinates and is clipped to the screen.
+ * @param[in] x        the area left coordinate.
+ * @param[in] y        the area top coordinate.
+ * @param[in] width    the area width.
+ * @param[in] height   the area height.
+ */
+void heatmap_add(int x, int y, int width, int height);
+
+
+/**
+ * Writes the accumulated heatmap into the output file.
+ *
+ * The heatmap is written as a 16 bit binary PGM image, normalized so that
+ * the most often damaged cell is white.
+ * @return   true if the heatmap was written successfully.
+ */
+bool heatmap_write();
+
+#endif
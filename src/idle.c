@@ -0,0 +1,287 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "idle.h"
+#include "application.h"
+#include "report.h"
+#include "xhandler.h"
+
+/**
+ * Window damage statistics.
+ */
+typedef struct {
+	/* the window id */
+	Window window;
+	/* the owner application name */
+	char* name;
+	/* number of damage events */
+	unsigned long events;
+	/* number of damaged pixels */
+	unsigned long long pixels;
+	/* number of damage events received while idle */
+	unsigned long idle_events;
+	/* number of pixels damaged while idle */
+	unsigned long long idle_pixels;
+} idle_window_t;
+
+
+/**
+ * Application damage statistics, summarized from its window statistics
+ * when generating report.
+ */
+typedef struct {
+	/* the application name */
+	const char* name;
+	/* the total statistics */
+	unsigned long events;
+	unsigned long long pixels;
+	unsigned long idle_events;
+	unsigned long long idle_pixels;
+	/* the application windows, sorted by the number of damaged pixels */
+	GList* windows;
+} idle_app_t;
+
+
+/**
+ * Idle repaint analysis data.
+ */
+typedef struct {
+	/* the idle period (msecs) */
+	unsigned int timeout;
+	/* the analysis start timestamp */
+	Time start;
+	/* the last user input timestamp */
+	Time last_input;
+	/* the last damage timestamp */
+	Time last_damage;
+	/* window statistics, indexed by window id */
+	GHashTable* windows;
+} idle_t;
+
+static idle_t idle = {
+		.timeout = 0,
+		.start = 0,
+		.last_input = 0,
+		.last_damage = 0,
+		.windows = NULL,
+};
+
+
+/**
+ * Releases resources allocated by window statistics.
+ *
+ * @param[in] stats   the window statistics to free.
+ */
+static void idle_window_free(idle_window_t* stats)
+{
+	g_free(stats->name);
+	g_slice_free(idle_window_t, stats);
+}
+
+
+/**
+ * Compares windows by the number of damaged pixels in descending order.
+ */
+static gint compare_windows_by_pixels(const idle_window_t* w1, const idle_window_t* w2)
+{
+	if (w1->pixels == w2->pixels) return 0;
+	return w1->pixels > w2->pixels ? -1 : 1;
+}
+
+
+/**
+ * Compares applications by the number of damaged pixels in descending order.
+ */
+static gint compare_apps_by_pixels(const idle_app_t* app1, const idle_app_t* app2)
+{
+	if (app1->pixels == app2->pixels) return 0;
+	return app1->pixels > app2->pixels ? -1 : 1;
+}
+
+
+/**
+ * Adds window statistics to the owner application statistics.
+ *
+ * @param[in] key     unused.
+ * @param[in] stats   the window statistics.
+ * @param[in] apps    the application statistics table, indexed by name.
+ */
+static void summarize_window(gpointer __attribute__((unused)) key, idle_window_t* stats, GHashTable* apps)
+{
+	idle_app_t* app = g_hash_table_lookup(apps, stats->name);
+	if (!app) {
+		app = g_slice_new0(idle_app_t);
+		app->name = stats->name;
+		g_hash_table_insert(apps, (gpointer)app->name, app);
+	}
+	app->events += stats->events;
+	app->pixels += stats->pixels;
+	app->idle_events += stats->idle_events;
+	app->idle_pixels += stats->idle_pixels;
+	app->windows = g_list_insert_sorted(app->windows, stats, (GCompareFunc)compare_windows_by_pixels);
+}
+
+
+/**
+ * Collects application statistics into a list.
+ */
+static void collect_app(gpointer __attribute__((unused)) key, idle_app_t* app, GList** list)
+{
+	*list = g_list_insert_sorted(*list, app, (GCompareFunc)compare_apps_by_pixels);
+}
+
+
+/**
+ * Reports application damage statistics.
+ *
+ * @param[in] app       the application statistics.
+ * @param[in] duration  the analysis duration in msecs.
+ */
+static void report_app(idle_app_t* app, unsigned long* duration)
+{
+	double secs = *duration / 1000.0;
+	GList* node;
+	int count = 0;
+
+	report_add_message_forced("\t%32s %8.1f %12.0f %8lu %12llu%s\n", app->name,
+			app->events / secs, app->pixels / secs, app->idle_events, app->idle_pixels,
+			app->idle_events ? " IDLE REPAINT" : "");
+
+	for (node = app->windows; node && count < IDLE_TOP_WINDOWS; node = node->next, count++) {
+		idle_window_t* stats = node->data;
+		report_add_message_forced("\t%32s 0x%lx: %lu events, %llu pixels (idle: %lu events, %llu pixels)\n", "",
+				stats->window, stats->events, stats->pixels, stats->idle_events, stats->idle_pixels);
+	}
+}
+
+
+/**
+ * Releases resources allocated by the summarized application statistics.
+ */
+static void idle_app_free(idle_app_t* app, void* __attribute__((unused)) data)
+{
+	g_list_free(app->windows);
+	g_slice_free(idle_app_t, app);
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+void idle_init(unsigned int timeout, Time timestamp)
+{
+	idle.timeout = timeout;
+	idle.start = timestamp;
+	idle.last_input = timestamp;
+	idle.last_damage = timestamp;
+	if (!idle.windows) {
+		idle.windows = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)idle_window_free);
+	}
+}
+
+
+void idle_fini()
+{
+	if (idle.windows) {
+		g_hash_table_destroy(idle.windows);
+		idle.windows = NULL;
+	}
+}
+
+
+bool idle_enabled()
+{
+	return idle.windows != NULL;
+}
+
+
+void idle_register_input(Time timestamp)
+{
+	if (timestamp > idle.last_input) idle.last_input = timestamp;
+}
+
+
+void idle_register_damage(window_t* win, XDamageNotifyEvent* dev)
+{
+	if (!idle.windows) return;
+
+	idle_window_t* stats = g_hash_table_lookup(idle.windows, (gconstpointer)dev->drawable);
+	if (!stats) {
+		stats = g_slice_new0(idle_window_t);
+		stats->window = dev->drawable;
+		stats->name = g_strdup(win && win->application ? win->application->name : "unknown");
+		g_hash_table_insert(idle.windows, (gpointer)stats->window, stats);
+	}
+	unsigned long pixels = dev->area.width * dev->area.height;
+	stats->events++;
+	stats->pixels += pixels;
+	if (dev->timestamp > idle.last_input && dev->timestamp - idle.last_input >= idle.timeout) {
+		stats->idle_events++;
+		stats->idle_pixels += pixels;
+	}
+	if (dev->timestamp > idle.last_damage) idle.last_damage = dev->timestamp;
+}
+
+
+void idle_report()
+{
+	if (!idle.windows) return;
+
+	GHashTable* apps = g_hash_table_new(g_str_hash, g_str_equal);
+	GList* list = NULL;
+	/* the rates are calculated over the whole analysis, not only until the last damage */
+	Time end = xhandler_get_server_time();
+	if (end < idle.last_damage) end = idle.last_damage;
+	unsigned long duration = end - idle.start;
+	if (!duration) duration = 1;
+
+	g_hash_table_foreach(idle.windows, (GHFunc)summarize_window, apps);
+	g_hash_table_foreach(apps, (GHFunc)collect_app, &list);
+
+	report_add_message_forced("Damage statistics over %lums (idle after %ums without user input):\n",
+			duration, idle.timeout);
+	report_add_message_forced("\t%32s %8s %12s %8s %12s\n", "application", "events/s", "pixels/s",
+			"idle ev", "idle pixels");
+	g_list_foreach(list, (GFunc)report_app, &duration);
+	report_add_message_forced("\n");
+
+	g_list_foreach(list, (GFunc)idle_app_free, NULL);
+	g_list_free(list);
+	g_hash_table_destroy(apps);
+}
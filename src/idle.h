@@ -0,0 +1,104 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file idle.h
+ * Idle repaint analysis.
+ *
+ * idle.c|h files collect per window/application damage statistics over the
+ * whole monitoring session and report applications that keep repainting
+ * while no user input has been seen for the specified period of time.
+ * User input is detected with XRecord (see xinput.c|h).
+ */
+
+#ifndef _IDLE_H_
+#define _IDLE_H_
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+
+#include "window.h"
+
+/* number of the largest repainting windows reported per application */
+#define IDLE_TOP_WINDOWS	3
+
+/**
+ * Initializes idle repaint analysis.
+ *
+ * @param[in] timeout    the period without user input (in milliseconds) after
+ *                       which the damage is considered to be idle repaint.
+ * @param[in] timestamp  the analysis start timestamp (server time).
+ */
+void idle_init(unsigned int timeout, Time timestamp);
+
+
+/**
+ * Releases resources allocated by idle repaint analysis.
+ */
+void idle_fini();
+
+
+/**
+ * Checks if idle repaint analysis is enabled.
+ *
+ * @return   true if the analysis is enabled.
+ */
+bool idle_enabled();
+
+
+/**
+ * Registers user input event.
+ *
+ * @param[in] timestamp   the input event timestamp (server time).
+ */
+void idle_register_input(Time timestamp);
+
+
+/**
+ * Registers damage event.
+ *
+ * @param[in] win   the damaged window (can be NULL).
+ * @param[in] dev   the damage event.
+ */
+void idle_register_damage(window_t* win, XDamageNotifyEvent* dev);
+
+
+/**
+ * Reports the collected damage statistics.
+ *
+ * The damage rates are calculated over the time from the analysis start
+ * until the report.
+ */
+void idle_report();
+
+#endif
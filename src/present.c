@@ -0,0 +1,229 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include <X11/Xlibint.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/present.h>
+
+#include "present.h"
+#include "window.h"
+#include "xhandler.h"
+#include "report.h"
+
+/**
+ * Presented frames of an application after user action.
+ */
+typedef struct {
+	/* the UST of the first and last presented frame (usecs) */
+	uint64_t first_ust;
+	uint64_t last_ust;
+	/* the MSC of the first and last presented frame */
+	uint64_t first_msc;
+	uint64_t last_msc;
+	/* the number of presented frames */
+	unsigned int frames;
+	/* the number of frames presented by flipping */
+	unsigned int flips;
+} present_frames_t;
+
+present_t present = {
+		.enabled = false,
+		.opcode = 0,
+};
+
+/* the presented frames of applications after user action (application_t -> present_frames_t) */
+static GHashTable* applications = NULL;
+
+/* the connection used for selecting events */
+static xcb_connection_t* connection = NULL;
+
+
+/**
+ * Converts Present extension wire event into event cookie data.
+ *
+ * Used only with the Xlib event backend. The cookie data is stored in the XCB
+ * event layout, which has the full sequence number inserted after the first
+ * 32 bytes of the wire event.
+ */
+static Bool present_wire_to_cookie(Display* dpy, XGenericEventCookie* cookie, xEvent* event)
+{
+	xGenericEvent* wire = (xGenericEvent*)event;
+	cookie->type = wire->type & 0x7F;
+	cookie->serial = _XSetLastRequestRead(dpy, (xGenericReply*)wire);
+	cookie->send_event = (wire->type & 0x80) != 0;
+	cookie->display = dpy;
+	cookie->extension = wire->extension;
+	cookie->evtype = wire->evtype;
+	cookie->data = NULL;
+	if (wire->evtype != XCB_PRESENT_COMPLETE_NOTIFY) return True;
+
+	xcb_present_complete_notify_event_t* ev = malloc(sizeof(xcb_present_complete_notify_event_t));
+	if (!ev) return False;
+	memcpy(ev, wire, sizeof(xEvent));
+	memcpy(&ev->msc, (char*)wire + sizeof(xEvent), sizeof(ev->msc));
+	ev->full_sequence = cookie->serial;
+	cookie->data = ev;
+	return True;
+}
+
+
+/**
+ * Copies Present extension event cookie data.
+ */
+static Bool present_copy_cookie(Display* __attribute__((unused)) dpy, XGenericEventCookie* in, XGenericEventCookie* out)
+{
+	*out = *in;
+	if (in->data) {
+		out->data = malloc(sizeof(xcb_present_complete_notify_event_t));
+		if (!out->data) return False;
+		memcpy(out->data, in->data, sizeof(xcb_present_complete_notify_event_t));
+	}
+	return True;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool present_init(Display* dpy)
+{
+	int event, error;
+	if (!XQueryExtension(dpy, "Present", &present.opcode, &event, &error)) return false;
+
+	connection = XGetXCBConnection(dpy);
+	xcb_present_query_version_reply_t* version = xcb_present_query_version_reply(connection,
+			xcb_present_query_version(connection, 1, 0), NULL);
+	if (!version) return false;
+	free(version);
+
+	/* used by the Xlib event backend, the XCB event backend converts the Present events itself */
+	XESetWireToEventCookie(dpy, present.opcode, present_wire_to_cookie);
+	XESetCopyEventCookie(dpy, present.opcode, present_copy_cookie);
+
+	applications = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+	present.enabled = true;
+	return true;
+}
+
+
+void present_fini()
+{
+	if (applications) {
+		g_hash_table_destroy(applications);
+		applications = NULL;
+	}
+	present.enabled = false;
+}
+
+
+uint32_t present_select_window(Window window)
+{
+	if (!present.enabled) return 0;
+
+	uint32_t context = xcb_generate_id(connection);
+	xcb_present_select_input(connection, context, window, XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY);
+	return context;
+}
+
+
+void present_deselect_window(Window window, uint32_t context)
+{
+	if (!present.enabled || !context) return;
+
+	/* deselecting all events destroys the event context */
+	xcb_present_select_input(connection, context, window, XCB_PRESENT_EVENT_MASK_NO_EVENT);
+}
+
+
+void present_process_event(XEvent* ev)
+{
+	XGenericEventCookie* cookie = &ev->xcookie;
+	if (!present.enabled || cookie->extension != present.opcode || cookie->evtype != XCB_PRESENT_COMPLETE_NOTIFY) {
+		return;
+	}
+	/* the XCB event backend provides already converted event data */
+	if (xhandler.backend == XHANDLER_BACKEND_XLIB && !XGetEventData(xhandler.display, cookie)) return;
+
+	xcb_present_complete_notify_event_t* complete = cookie->data;
+	if (complete && complete->kind == XCB_PRESENT_COMPLETE_KIND_PIXMAP && response.last_action_time &&
+			(int32_t)((uint32_t)(complete->ust / 1000) - (uint32_t)response.last_action_time) >= 0) {
+		window_t* win = window_find(complete->window);
+		if (win && win->application) {
+			present_frames_t* frames = g_hash_table_lookup(applications, win->application);
+			if (!frames) {
+				frames = g_new0(present_frames_t, 1);
+				frames->first_ust = complete->ust;
+				frames->first_msc = complete->msc;
+				g_hash_table_insert(applications, win->application, frames);
+			}
+			frames->last_ust = complete->ust;
+			frames->last_msc = complete->msc;
+			frames->frames++;
+			if (complete->mode == XCB_PRESENT_COMPLETE_MODE_FLIP) frames->flips++;
+			report_add_message(complete->ust / 1000, "Got present complete event 0x%lx (%s) msc %llu%s\n",
+					win->window, win->application->name, (unsigned long long)complete->msc,
+					complete->mode == XCB_PRESENT_COMPLETE_MODE_FLIP ? " flip" : "");
+		}
+	}
+	if (xhandler.backend == XHANDLER_BACKEND_XLIB) XFreeEventData(xhandler.display, cookie);
+}
+
+
+void present_start()
+{
+	if (applications) g_hash_table_remove_all(applications);
+}
+
+
+void present_report_application(application_t* app, Time action, Time last_damage)
+{
+	if (!applications) return;
+
+	present_frames_t* frames = g_hash_table_lookup(applications, app);
+	if (!frames) return;
+
+	int first = (uint32_t)(frames->first_ust / 1000) - (uint32_t)action;
+	int last = (uint32_t)(frames->last_ust / 1000) - (uint32_t)action;
+	report_add_message_forced("\t%32s presented: first %5ims, last %5ims, frames %u (%u flips), msc %llu-%llu, "
+			"last present after last damage %ims\n", "", first, last, frames->frames, frames->flips,
+			(unsigned long long)frames->first_msc, (unsigned long long)frames->last_msc,
+			last - (int)(last_damage - action));
+	g_hash_table_remove(applications, app);
+}
@@ -0,0 +1,124 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file present.h
+ * Present extension frame completion monitoring.
+ *
+ * present.c|h files select Present extension complete notifications for the
+ * monitored windows. The notifications report when the frames rendered by
+ * the applications were actually presented (UST/MSC), so the response report
+ * can show the presentation times next to the damage based times.
+ */
+
+#ifndef _PRESENT_H_
+#define _PRESENT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <X11/Xlib.h>
+
+#include "application.h"
+
+/**
+ * Present extension monitoring data.
+ */
+typedef struct {
+	/* true if frame completion monitoring is enabled */
+	bool enabled;
+	/* the Present extension major opcode */
+	int opcode;
+} present_t;
+
+extern present_t present;
+
+
+/**
+ * Initializes Present extension frame completion monitoring.
+ *
+ * @param[in] dpy   the connected display.
+ * @return          true if the Present extension is supported.
+ */
+bool present_init(Display* dpy);
+
+
+/**
+ * Releases resources allocated by frame completion monitoring.
+ */
+void present_fini();
+
+
+/**
+ * Selects frame completion notifications for a monitored window.
+ *
+ * @param[in] window   the window.
+ * @return             the Present event context or 0 if monitoring is not enabled.
+ */
+uint32_t present_select_window(Window window);
+
+
+/**
+ * Deselects frame completion notifications of a monitored window.
+ *
+ * @param[in] window    the window.
+ * @param[in] context   the Present event context returned by present_select_window().
+ */
+void present_deselect_window(Window window, uint32_t context);
+
+
+/**
+ * Processes Present extension generic event.
+ *
+ * @param[in] ev   the generic event.
+ */
+void present_process_event(XEvent* ev);
+
+
+/**
+ * Resets the presented frames at the start of user action.
+ */
+void present_start();
+
+
+/**
+ * Reports the presented frames of an application after user action.
+ *
+ * The presentation times are reported relative to the user action. The X
+ * server timestamps and the UST of the presented frames are both based on
+ * the monotonic clock, so they can be compared directly.
+ * @param[in] app           the application.
+ * @param[in] action        the user action timestamp.
+ * @param[in] last_damage   the last damage timestamp of the application.
+ */
+void present_report_application(application_t* app, Time action, Time last_damage);
+
+#endif
@@ -0,0 +1,332 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "recorder.h"
+#include "content.h"
+#include "area.h"
+#include "report.h"
+
+/**
+ * Region snapshot.
+ */
+typedef struct {
+	/* the timestamp of the damage triggering the snapshot */
+	Time timestamp;
+	/* the snapshot pixels, rect.width * rect.height 32 bit pixels in server byte order */
+	uint8_t* data;
+} recorder_frame_t;
+
+/**
+ * Flight recorder data.
+ */
+typedef struct {
+	/* the recorded region in screen */
+	Rectangle rect;
+	/* the response latency budget (msecs) */
+	int budget;
+	/* the snapshot directory */
+	char* directory;
+	/* the root window */
+	Window root;
+	/* the visual color masks and image byte order used to write snapshots */
+	unsigned long red_mask;
+	unsigned long green_mask;
+	unsigned long blue_mask;
+	bool msb;
+	/* the snapshot ring */
+	recorder_frame_t* frames;
+	/* the ring size */
+	int size;
+	/* the next ring slot */
+	int head;
+	/* the number of frames in ring */
+	int count;
+	/* the snapshot buffers, allocated at initialization */
+	uint8_t* storage;
+	/* the line buffer used to write snapshots */
+	uint8_t* line;
+	/* the timestamp of the last damage not yet in snapshot */
+	Time pending;
+	/* the local time of the last snapshot */
+	struct timeval last_snapshot;
+	/* the number of written user actions */
+	int dumps;
+} recorder_t;
+
+static recorder_t recorder = {
+		.directory = NULL,
+		.frames = NULL,
+		.storage = NULL,
+		.line = NULL,
+		.pending = 0,
+		.dumps = 0,
+};
+
+
+/**
+ * Takes snapshot of the region into the next ring slot.
+ *
+ * @param[in] now   the current local time.
+ */
+static void recorder_snapshot(const struct timeval* now)
+{
+	Rectangle* rect = &recorder.rect;
+	int depth, bytes_per_line;
+	const uint8_t* pixels = content_fetch(recorder.root, rect->x, rect->y, rect->width, rect->height, &depth,
+			&bytes_per_line);
+	recorder.last_snapshot = *now;
+	if (!pixels || bytes_per_line < rect->width * 4) return;
+
+	recorder_frame_t* frame = &recorder.frames[recorder.head];
+	int line;
+	for (line = 0; line < rect->height; line++) {
+		memcpy(frame->data + line * rect->width * 4, pixels + line * bytes_per_line, rect->width * 4);
+	}
+	frame->timestamp = recorder.pending;
+	recorder.pending = 0;
+	recorder.head = (recorder.head + 1) % recorder.size;
+	if (recorder.count < recorder.size) recorder.count++;
+}
+
+
+/**
+ * Converts pixel color channel into 8 bit value.
+ *
+ * @param[in] pixel   the pixel value.
+ * @param[in] mask    the channel mask of the visual.
+ * @return            the channel value.
+ */
+static uint8_t pixel_to_channel(uint32_t pixel, unsigned long mask)
+{
+	int shift = ffsl(mask) - 1;
+	int bits = ffsl((mask >> shift) + 1) - 1;
+	unsigned long value = (pixel & mask) >> shift;
+	return bits >= 8 ? value >> (bits - 8) : value << (8 - bits);
+}
+
+
+/**
+ * Writes snapshot into binary PPM image.
+ *
+ * @param[in] frame      the snapshot.
+ * @param[in] filename   the image file name.
+ * @return               true if the image was written.
+ */
+static bool recorder_write_frame(const recorder_frame_t* frame, const char* filename)
+{
+	FILE* fp = fopen(filename, "wb");
+	if (!fp) return false;
+
+	Rectangle* rect = &recorder.rect;
+	fprintf(fp, "P6\n%d %d\n255\n", rect->width, rect->height);
+	int line, x;
+	for (line = 0; line < rect->height; line++) {
+		const uint8_t* data = frame->data + line * rect->width * 4;
+		for (x = 0; x < rect->width; x++) {
+			uint32_t pixel = recorder.msb ? (uint32_t)data[0] << 24 | data[1] << 16 | data[2] << 8 | data[3] :
+					(uint32_t)data[3] << 24 | data[2] << 16 | data[1] << 8 | data[0];
+			recorder.line[x * 3] = pixel_to_channel(pixel, recorder.red_mask);
+			recorder.line[x * 3 + 1] = pixel_to_channel(pixel, recorder.green_mask);
+			recorder.line[x * 3 + 2] = pixel_to_channel(pixel, recorder.blue_mask);
+			data += 4;
+		}
+		fwrite(recorder.line, 1, rect->width * 3, fp);
+	}
+	return fclose(fp) == 0;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool recorder_init(Display* dpy, const char* text)
+{
+	char** fields = g_strsplit(text, ",", 4);
+	bool rc = false;
+
+	if (!fields[0] || !fields[1]) goto out;
+	recorder.budget = atoi(fields[0]);
+	recorder.size = fields[2] ? atoi(fields[2]) : 0;
+	if (recorder.size <= 0) recorder.size = RECORDER_DEFAULT_FRAMES;
+
+	if (fields[2] && fields[3]) {
+		area_t* area;
+		if (sscanf(fields[3], "%dx%d+%d+%d", &recorder.rect.width, &recorder.rect.height, &recorder.rect.x,
+				&recorder.rect.y) != 4) {
+			if (!(area = area_find(fields[3]))) {
+				fprintf(stderr, "*** unknown region '%s'\n", fields[3]);
+				goto out;
+			}
+			recorder.rect = area->rect;
+		}
+	}
+	else {
+		recorder.rect.x = 0;
+		recorder.rect.y = 0;
+		recorder.rect.width = DisplayWidth(dpy, DefaultScreen(dpy));
+		recorder.rect.height = DisplayHeight(dpy, DefaultScreen(dpy));
+	}
+	if (recorder.rect.width <= 0 || recorder.rect.height <= 0) {
+		fprintf(stderr, "*** empty flight recorder region\n");
+		goto out;
+	}
+	if (access(fields[1], W_OK)) {
+		fprintf(stderr, "*** flight recorder directory %s is not writable\n", fields[1]);
+		goto out;
+	}
+	if (DefaultDepth(dpy, DefaultScreen(dpy)) < 24) {
+		fprintf(stderr, "*** flight recorder requires 24 or 32 bit screen depth\n");
+		goto out;
+	}
+	if (!content_init(dpy, false)) {
+		fprintf(stderr, "*** flight recorder requires MIT-SHM extension\n");
+		goto out;
+	}
+
+	Visual* visual = DefaultVisual(dpy, DefaultScreen(dpy));
+	recorder.red_mask = visual->red_mask;
+	recorder.green_mask = visual->green_mask;
+	recorder.blue_mask = visual->blue_mask;
+	recorder.msb = ImageByteOrder(dpy) == MSBFirst;
+	recorder.root = DefaultRootWindow(dpy);
+	g_free(recorder.directory);
+	recorder.directory = g_strdup(fields[1]);
+
+	/* allocate all snapshot buffers up front, so taking snapshots doesn't allocate memory */
+	size_t frame_size = (size_t)recorder.rect.width * recorder.rect.height * 4;
+	g_free(recorder.frames);
+	g_free(recorder.storage);
+	g_free(recorder.line);
+	recorder.frames = g_new0(recorder_frame_t, recorder.size);
+	recorder.storage = g_malloc(frame_size * recorder.size);
+	recorder.line = g_malloc(recorder.rect.width * 3);
+	int i;
+	for (i = 0; i < recorder.size; i++) {
+		recorder.frames[i].data = recorder.storage + frame_size * i;
+	}
+	recorder.head = 0;
+	recorder.count = 0;
+	rc = true;
+
+out:
+	g_strfreev(fields);
+	return rc;
+}
+
+
+void recorder_fini()
+{
+	g_free(recorder.frames);
+	g_free(recorder.storage);
+	g_free(recorder.line);
+	g_free(recorder.directory);
+	recorder.frames = NULL;
+	recorder.storage = NULL;
+	recorder.line = NULL;
+	recorder.directory = NULL;
+	recorder.pending = 0;
+	recorder.dumps = 0;
+	timerclear(&recorder.last_snapshot);
+}
+
+
+void recorder_register_damage(int x, int y, int width, int height, Time timestamp)
+{
+	if (!recorder.storage) return;
+
+	Rectangle* rect = &recorder.rect;
+	if (x >= rect->x + rect->width || x + width <= rect->x || y >= rect->y + rect->height || y + height <= rect->y) {
+		return;
+	}
+	recorder.pending = timestamp;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	recorder_update(&now);
+}
+
+
+void recorder_update(const struct timeval* now)
+{
+	if (recorder.pending && ((now->tv_sec - recorder.last_snapshot.tv_sec) * 1000 +
+			(now->tv_usec - recorder.last_snapshot.tv_usec) / 1000) >= RECORDER_MIN_INTERVAL) {
+		recorder_snapshot(now);
+	}
+}
+
+
+void recorder_finish(Time action)
+{
+	if (!recorder.storage) return;
+
+	/* the snapshot of pending damage would be taken after the response checking has ended */
+	if (recorder.pending) {
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		recorder_snapshot(&now);
+	}
+
+	/* find the first snapshot of the user action, preceded by the last snapshot before it */
+	int first = 0, i;
+	Time last = 0;
+	for (i = 0; i < recorder.count; i++) {
+		recorder_frame_t* frame = &recorder.frames[(recorder.head + recorder.size - 1 - i) % recorder.size];
+		if (frame->timestamp < action) break;
+		if (!last) last = frame->timestamp;
+		first = i + 1;
+	}
+	if (!last || (long)(last - action) <= recorder.budget) return;
+	if (first < recorder.count) first++;
+
+	int written = 0;
+	recorder.dumps++;
+	for (i = first - 1; i >= 0; i--) {
+		recorder_frame_t* frame = &recorder.frames[(recorder.head + recorder.size - 1 - i) % recorder.size];
+		char* filename = g_strdup_printf("%s/slow%03d-%02d%+ldms.ppm", recorder.directory, recorder.dumps,
+				written, (long)frame->timestamp - (long)action);
+		if (recorder_write_frame(frame, filename)) written++;
+		else fprintf(stderr, "*** failed to write flight recorder snapshot %s\n", filename);
+		g_free(filename);
+	}
+	report_add_message_forced("\t%32s response %lums exceeds budget %dms, %d snapshots written to %s/slow%03d-*.ppm\n",
+			"(recorder)", last - action, recorder.budget, written, recorder.directory, recorder.dumps);
+}
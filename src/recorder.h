@@ -0,0 +1,108 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file recorder.h
+ * Slow response flight recorder.
+ *
+ * recorder.c|h files keep the last screen region snapshots in a ring of
+ * buffers allocated at initialization. The region is fetched through MIT-SHM
+ * when damage touches it. When the response to a user action exceeds the
+ * latency budget, the snapshots from the last one before the action are
+ * written into PPM images, so slow responses can be inspected without
+ * recording the whole run.
+ */
+
+#ifndef _RECORDER_H_
+#define _RECORDER_H_
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include <X11/Xlib.h>
+
+/* the default number of kept snapshots */
+#define RECORDER_DEFAULT_FRAMES		8
+
+/* the minimum interval between snapshots (msecs) */
+#define RECORDER_MIN_INTERVAL		16
+
+/**
+ * Initializes the flight recorder.
+ *
+ * @param[in] dpy    the connected display.
+ * @param[in] text   the recorder parameters - budget,directory[,frames[,REGION]],
+ *                   where budget is the response latency budget (msecs) and
+ *                   REGION is either WxH+X+Y or the name of a monitored area.
+ *                   The whole screen is recorded by default.
+ * @return           true if the recorder was initialized.
+ */
+bool recorder_init(Display* dpy, const char* text);
+
+
+/**
+ * Releases resources allocated by the flight recorder.
+ */
+void recorder_fini();
+
+
+/**
+ * Registers damage, taking snapshot if the minimum snapshot interval
+ * has elapsed.
+ *
+ * @param[in] x           the damage left coordinate in screen.
+ * @param[in] y           the damage top coordinate in screen.
+ * @param[in] width       the damage width.
+ * @param[in] height      the damage height.
+ * @param[in] timestamp   the damage timestamp.
+ */
+void recorder_register_damage(int x, int y, int width, int height, Time timestamp);
+
+
+/**
+ * Takes snapshot if the region was damaged after the last snapshot
+ * and the minimum snapshot interval has elapsed.
+ *
+ * @param[in] now   the current local time.
+ */
+void recorder_update(const struct timeval* now);
+
+
+/**
+ * Writes the snapshots of the user action if its response exceeds the budget.
+ *
+ * The response latency is the time of the last recorded damage after the
+ * user action.
+ * @param[in] action   the user action timestamp.
+ */
+void recorder_finish(Time action);
+
+#endif
@@ -0,0 +1,303 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <strings.h>
+
+#include <glib.h>
+
+#include <X11/Xutil.h>
+
+#include "reference.h"
+#include "content.h"
+#include "area.h"
+#include "report.h"
+
+/**
+ * Reference image condition data.
+ */
+typedef struct {
+	/* the reference image file name */
+	char* filename;
+	/* the reference region in screen */
+	Rectangle rect;
+	/* the maximum mean absolute difference of color channels */
+	double tolerance;
+	/* the reference image in screen pixel format, rect.width * rect.height * 4 bytes */
+	uint8_t* pixels;
+	/* the color channel byte mask of a single image line */
+	uint8_t* mask;
+	/* the root window */
+	Window root;
+	/* the number of region content checks */
+	unsigned long checks;
+} reference_t;
+
+static reference_t reference = {
+		.filename = NULL,
+		.pixels = NULL,
+		.mask = NULL,
+		.checks = 0,
+};
+
+
+/**
+ * Calculates sum of absolute differences of the masked bytes.
+ *
+ * The loop has no dependencies between iterations except the sum, allowing
+ * the compiler to vectorize it.
+ * @param[in] data1    the first data span.
+ * @param[in] data2    the second data span.
+ * @param[in] mask     the byte mask.
+ * @param[in] length   the span length (in bytes).
+ * @return             the sum of absolute differences.
+ */
+static inline unsigned int sad_span(const uint8_t* __restrict data1, const uint8_t* __restrict data2,
+		const uint8_t* __restrict mask, int length)
+{
+	unsigned int sum = 0;
+	int i;
+	for (i = 0; i < length; i++) {
+		int diff = data1[i] - data2[i];
+		sum += (diff < 0 ? -diff : diff) & mask[i];
+	}
+	return sum;
+}
+
+
+/**
+ * Skips whitespace and comments in PPM header.
+ */
+static void ppm_skip(FILE* fp)
+{
+	int c;
+	while ((c = fgetc(fp)) != EOF) {
+		if (c == '#') {
+			while ((c = fgetc(fp)) != EOF && c != '\n');
+		}
+		else if (!isspace(c)) {
+			ungetc(c, fp);
+			break;
+		}
+	}
+}
+
+
+/**
+ * Reads binary PPM (P6) image with 8 bit channels.
+ *
+ * @param[in] filename   the image file name.
+ * @param[out] width     the image width.
+ * @param[out] height    the image height.
+ * @return               the RGB image data or NULL on failure.
+ */
+static uint8_t* ppm_read(const char* filename, int* width, int* height)
+{
+	FILE* fp = fopen(filename, "rb");
+	if (!fp) return NULL;
+
+	uint8_t* rgb = NULL;
+	char magic[3] = "";
+	int maxval = 0;
+	if (fscanf(fp, "%2s", magic) == 1 && !strcmp(magic, "P6")) {
+		ppm_skip(fp);
+		if (fscanf(fp, "%d", width) == 1) ppm_skip(fp);
+		if (fscanf(fp, "%d", height) == 1) ppm_skip(fp);
+		/* a single whitespace character separates the header from the data */
+		if (fscanf(fp, "%d", &maxval) == 1 && maxval == 255 && *width > 0 && *height > 0 && fgetc(fp) != EOF) {
+			size_t size = (size_t)*width * *height * 3;
+			rgb = g_malloc(size);
+			if (fread(rgb, 1, size, fp) != size) {
+				g_free(rgb);
+				rgb = NULL;
+			}
+		}
+	}
+	fclose(fp);
+	return rgb;
+}
+
+
+/**
+ * Converts 8 bit color channel value to pixel value.
+ *
+ * @param[in] value   the channel value.
+ * @param[in] mask    the channel mask of the visual.
+ * @return            the channel bits of the pixel.
+ */
+static unsigned long channel_to_pixel(unsigned int value, unsigned long mask)
+{
+	int shift = ffsl(mask) - 1;
+	int bits = ffsl((mask >> shift) + 1) - 1;
+	return ((unsigned long)(bits >= 8 ? value << (bits - 8) : value >> (8 - bits)) << shift) & mask;
+}
+
+
+/**
+ * Stores pixel value in the server image byte order.
+ *
+ * @param[out] data     the pixel data (4 bytes).
+ * @param[in] pixel     the pixel value.
+ * @param[in] msb       true for the most significant byte first order.
+ */
+static void store_pixel(uint8_t* data, uint32_t pixel, bool msb)
+{
+	int i;
+	for (i = 0; i < 4; i++) {
+		data[msb ? 3 - i : i] = pixel >> (i * 8);
+	}
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool reference_init(Display* dpy, const char* text)
+{
+	char** fields = g_strsplit(text, ",", 3);
+	bool rc = false;
+	int width, height;
+	uint8_t* rgb = NULL;
+
+	if (!fields[0] || !fields[1]) goto out;
+
+	area_t* area;
+	if (sscanf(fields[0], "%dx%d+%d+%d", &reference.rect.width, &reference.rect.height,
+			&reference.rect.x, &reference.rect.y) != 4) {
+		if (!(area = area_find(fields[0]))) {
+			fprintf(stderr, "*** unknown region '%s'\n", fields[0]);
+			goto out;
+		}
+		reference.rect = area->rect;
+	}
+	reference.tolerance = fields[2] ? atof(fields[2]) : 0;
+
+	if (!(rgb = ppm_read(fields[1], &width, &height))) {
+		fprintf(stderr, "*** failed to read binary PPM image %s\n", fields[1]);
+		goto out;
+	}
+	if (width != reference.rect.width || height != reference.rect.height) {
+		fprintf(stderr, "*** reference image size %dx%d doesn't match region size %dx%d\n", width, height,
+				reference.rect.width, reference.rect.height);
+		goto out;
+	}
+	if (DefaultDepth(dpy, DefaultScreen(dpy)) < 24) {
+		fprintf(stderr, "*** reference images require 24 or 32 bit screen depth\n");
+		goto out;
+	}
+	if (!content_init(dpy, false)) {
+		fprintf(stderr, "*** reference images require MIT-SHM extension\n");
+		goto out;
+	}
+
+	/* convert the image into the screen pixel format */
+	Visual* visual = DefaultVisual(dpy, DefaultScreen(dpy));
+	bool msb = ImageByteOrder(dpy) == MSBFirst;
+	int i;
+	g_free(reference.pixels);
+	g_free(reference.mask);
+	reference.pixels = g_malloc((size_t)width * height * 4);
+	reference.mask = g_malloc(width * 4);
+	for (i = 0; i < width * height; i++) {
+		uint8_t* color = rgb + i * 3;
+		store_pixel(reference.pixels + i * 4, channel_to_pixel(color[0], visual->red_mask) |
+				channel_to_pixel(color[1], visual->green_mask) | channel_to_pixel(color[2], visual->blue_mask), msb);
+	}
+	for (i = 0; i < width; i++) {
+		store_pixel(reference.mask + i * 4, visual->red_mask | visual->green_mask | visual->blue_mask, msb);
+	}
+	g_free(reference.filename);
+	reference.filename = g_strdup(fields[1]);
+	reference.root = DefaultRootWindow(dpy);
+	rc = true;
+
+out:
+	g_free(rgb);
+	g_strfreev(fields);
+	return rc;
+}
+
+
+void reference_fini()
+{
+	g_free(reference.pixels);
+	g_free(reference.mask);
+	g_free(reference.filename);
+	reference.pixels = NULL;
+	reference.mask = NULL;
+	reference.filename = NULL;
+	reference.checks = 0;
+}
+
+
+bool reference_check(int x, int y, int width, int height, Time timestamp, Time action)
+{
+	if (!reference.pixels) return false;
+
+	Rectangle* rect = &reference.rect;
+	if (x >= rect->x + rect->width || x + width <= rect->x || y >= rect->y + rect->height || y + height <= rect->y) {
+		return false;
+	}
+
+	int depth, bytes_per_line;
+	const uint8_t* pixels = content_fetch(reference.root, rect->x, rect->y, rect->width, rect->height, &depth, &bytes_per_line);
+	if (!pixels || bytes_per_line < rect->width * 4) return false;
+	reference.checks++;
+
+	/* stop comparing as soon as the difference exceeds tolerance */
+	unsigned long long limit = reference.tolerance * rect->width * rect->height * 3;
+	unsigned long long sum = 0;
+	int line;
+	for (line = 0; line < rect->height && sum <= limit; line++) {
+		sum += sad_span(pixels + line * bytes_per_line, reference.pixels + line * rect->width * 4, reference.mask,
+				rect->width * 4);
+	}
+	if (sum > limit) return false;
+
+	double difference = (double)sum / ((double)rect->width * rect->height * 3);
+	if (action && timestamp >= action) {
+		report_add_message_forced("Region %dx%d+%d+%d matches reference image %s %lums after user action "
+				"(mean difference %.2f, %lu checks)\n", rect->width, rect->height, rect->x, rect->y,
+				reference.filename, timestamp - action, difference, reference.checks);
+	}
+	else {
+		report_add_message_forced("Region %dx%d+%d+%d matches reference image %s at %lums "
+				"(mean difference %.2f, %lu checks)\n", rect->width, rect->height, rect->x, rect->y,
+				reference.filename, timestamp, difference, reference.checks);
+	}
+	return true;
+}
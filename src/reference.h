@@ -0,0 +1,81 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file reference.h
+ * Reference image end condition.
+ *
+ * reference.c|h files implement the --until-image end condition. When damage
+ * touches the reference region, the region content is fetched from the
+ * screen and compared with the reference image. The measurement ends when
+ * the mean absolute difference of the color channels is within the
+ * tolerance.
+ */
+
+#ifndef _REFERENCE_H_
+#define _REFERENCE_H_
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+
+/**
+ * Initializes the reference image condition.
+ *
+ * @param[in] dpy    the connected display.
+ * @param[in] text   the condition text - REGION,file.ppm[,tolerance], where
+ *                   REGION is either WxH+X+Y or the name of a monitored area.
+ * @return           true if the condition was parsed and the reference image loaded.
+ */
+bool reference_init(Display* dpy, const char* text);
+
+
+/**
+ * Releases resources allocated by the reference image condition.
+ */
+void reference_fini();
+
+
+/**
+ * Checks if the damaged screen area matches the reference image.
+ *
+ * The region content is checked only if the damage overlaps the region.
+ * @param[in] x           the damage left coordinate in screen.
+ * @param[in] y           the damage top coordinate in screen.
+ * @param[in] width       the damage width.
+ * @param[in] height      the damage height.
+ * @param[in] timestamp   the damage timestamp.
+ * @param[in] action      the last user action timestamp or 0 outside response measurement.
+ * @return                true if the region matches the reference image.
+ */
+bool reference_check(int x, int y, int width, int height, Time timestamp, Time action);
+
+#endif
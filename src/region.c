@@ -0,0 +1,180 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "region.h"
+
+/**
+ * Adds the part of a rectangle not covered by the region rectangles to the region.
+ *
+ * The rectangle is split around the first region rectangle it intersects and
+ * the split parts are checked against the following region rectangles, so the
+ * region rectangles stay disjoint.
+ * @param[in] region   the region.
+ * @param[in] rect     the rectangle to add.
+ * @param[in] start    the index of the first region rectangle to check.
+ */
+static void region_add_uncovered(region_t* region, const Rectangle* rect, guint start)
+{
+	guint i;
+
+	for (i = start; i < region->rects->len; i++) {
+		Rectangle clip = g_array_index(region->rects, Rectangle, i);
+		int x1 = MAX(rect->x, clip.x);
+		int y1 = MAX(rect->y, clip.y);
+		int x2 = MIN(rect->x + rect->width, clip.x + clip.width);
+		int y2 = MIN(rect->y + rect->height, clip.y + clip.height);
+		if (x1 >= x2 || y1 >= y2) continue;
+
+		Rectangle part;
+		/* the full width bands above and below the intersection */
+		if (y1 > rect->y) {
+			part = (Rectangle){rect->x, rect->y, rect->width, y1 - rect->y};
+			region_add_uncovered(region, &part, i + 1);
+		}
+		if (y2 < rect->y + rect->height) {
+			part = (Rectangle){rect->x, y2, rect->width, rect->y + rect->height - y2};
+			region_add_uncovered(region, &part, i + 1);
+		}
+		/* the parts on the left and right sides of the intersection */
+		if (x1 > rect->x) {
+			part = (Rectangle){rect->x, y1, x1 - rect->x, y2 - y1};
+			region_add_uncovered(region, &part, i + 1);
+		}
+		if (x2 < rect->x + rect->width) {
+			part = (Rectangle){x2, y1, rect->x + rect->width - x2, y2 - y1};
+			region_add_uncovered(region, &part, i + 1);
+		}
+		return;
+	}
+	g_array_append_val(region->rects, *rect);
+	region->area += (unsigned long long)rect->width * rect->height;
+}
+
+
+/**
+ * Replaces the region rectangles with their bounding box if there are
+ * too many of them.
+ */
+static void region_coalesce(region_t* region)
+{
+	guint i;
+
+	if (region->rects->len <= REGION_RECTS_MAX) return;
+
+	Rectangle* rect = &g_array_index(region->rects, Rectangle, 0);
+	int x1 = rect->x, y1 = rect->y, x2 = rect->x + rect->width, y2 = rect->y + rect->height;
+	for (i = 1; i < region->rects->len; i++) {
+		rect = &g_array_index(region->rects, Rectangle, i);
+		x1 = MIN(x1, rect->x);
+		y1 = MIN(y1, rect->y);
+		x2 = MAX(x2, rect->x + rect->width);
+		y2 = MAX(y2, rect->y + rect->height);
+	}
+	Rectangle bounds = {.x = x1, .y = y1, .width = x2 - x1, .height = y2 - y1};
+	g_array_set_size(region->rects, 0);
+	g_array_append_val(region->rects, bounds);
+	region->area = (unsigned long long)bounds.width * bounds.height;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+void region_init(region_t* region)
+{
+	region->rects = g_array_new(FALSE, FALSE, sizeof(Rectangle));
+	region->area_sum = 0;
+	region->area = 0;
+}
+
+
+void region_free(region_t* region)
+{
+	if (region->rects) {
+		g_array_free(region->rects, TRUE);
+		region->rects = NULL;
+	}
+}
+
+
+void region_clear(region_t* region)
+{
+	g_array_set_size(region->rects, 0);
+	region->area_sum = 0;
+	region->area = 0;
+}
+
+
+void region_add(region_t* region, int x, int y, int width, int height)
+{
+	if (width <= 0 || height <= 0) return;
+
+	Rectangle rect = {.x = x, .y = y, .width = width, .height = height};
+	region_add_uncovered(region, &rect, 0);
+	region_coalesce(region);
+	region->area_sum += (unsigned long long)width * height;
+}
+
+
+void region_merge(region_t* region, const region_t* source)
+{
+	guint i;
+
+	for (i = 0; i < source->rects->len; i++) {
+		region_add_uncovered(region, &g_array_index(source->rects, Rectangle, i), 0);
+	}
+	region_coalesce(region);
+	region->area_sum += source->area_sum;
+}
+
+
+bool region_empty(const region_t* region)
+{
+	return region->rects->len == 0;
+}
+
+
+unsigned long long region_area(const region_t* region)
+{
+	return region->area;
+}
+
+
+double region_overdraw(const region_t* region)
+{
+	return region->area ? (double)region->area_sum / region->area : 0;
+}
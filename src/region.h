@@ -0,0 +1,143 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file region.h
+ * Damage region accumulation.
+ *
+ * region.c|h files accumulate damaged rectangles as a set of disjoint
+ * rectangles, keeping the exact area covered by their union up to date.
+ * Together with the sum of damaged rectangle areas it gives the overdraw
+ * ratio - how many times on average every updated pixel was repainted.
+ */
+
+#ifndef _REGION_H_
+#define _REGION_H_
+
+#include <glib.h>
+
+#include "xresponse.h"
+
+/* the maximum number of disjoint rectangles, the region is reduced to its
+ * bounding box when exceeded */
+#define REGION_RECTS_MAX	256
+
+/**
+ * Damage region data structure.
+ */
+typedef struct {
+	/* the disjoint rectangles covering the damaged area (Rectangle) */
+	GArray* rects;
+	/* the sum of damaged rectangle areas */
+	unsigned long long area_sum;
+	/* the area covered by the rectangles */
+	unsigned long long area;
+} region_t;
+
+
+/**
+ * Initializes damage region.
+ *
+ * @param[in] region   the region to initialize.
+ */
+void region_init(region_t* region);
+
+
+/**
+ * Releases resources allocated by damage region.
+ *
+ * @param[in] region   the region to free.
+ */
+void region_free(region_t* region);
+
+
+/**
+ * Removes all rectangles from the region.
+ *
+ * The allocated memory is kept for reuse.
+ * @param[in] region   the region to clear.
+ */
+void region_clear(region_t* region);
+
+
+/**
+ * Adds rectangle to the region.
+ *
+ * Only the parts not covered by the region yet are stored. If the region
+ * consists of more than REGION_RECTS_MAX rectangles, it's reduced to its
+ * bounding box, making the covered area an upper estimate.
+ * @param[in] region   the region.
+ * @param[in] x        the rectangle left coordinate.
+ * @param[in] y        the rectangle top coordinate.
+ * @param[in] width    the rectangle width.
+ * @param[in] height   the rectangle height.
+ */
+void region_add(region_t* region, int x, int y, int width, int height);
+
+
+/**
+ * Adds all rectangles of the source region to the target region.
+ *
+ * @param[in] region   the target region.
+ * @param[in] source   the source region.
+ */
+void region_merge(region_t* region, const region_t* source);
+
+
+/**
+ * Checks if the region is empty.
+ *
+ * @param[in] region   the region.
+ * @return             true if the region contains no rectangles.
+ */
+bool region_empty(const region_t* region);
+
+
+/**
+ * Gets the area covered by the region (the union of its rectangles).
+ *
+ * @param[in] region   the region.
+ * @return             the covered area in pixels.
+ */
+unsigned long long region_area(const region_t* region);
+
+
+/**
+ * Calculates the region overdraw ratio.
+ *
+ * The overdraw ratio is the sum of damaged rectangle areas divided by
+ * the covered area.
+ * @param[in] region   the region.
+ * @return             the overdraw ratio or 0 if the region is empty.
+ */
+double region_overdraw(const region_t* region);
+
+#endif
@@ -80,6 +80,12 @@ typedef struct {
 	 * (damage reports and such) are hidden. Used for application response
 	 * reporting. */
 	bool silent;
+	/* true if the report header has been written */
+	bool header;
+	/* the timestamp of the last written record */
+	Time last_written;
+	/* the timestamp of the last added record */
+	Time last_added;
 } report_t;
 
 /* the report */
@@ -87,6 +93,9 @@ static report_t report = {
 		.fp = NULL,
 		.fp_owner = false,
 		.silent = false,
+		.header = false,
+		.last_written = 0,
+		.last_added = 0,
 };
 
 
@@ -109,26 +118,22 @@ static void record_free(record_t* rec, void* __attribute__((unused)) data)
  */
 static void report_write_record(record_t* rec, void* __attribute__((unused)) data)
 {
-	static bool displayed_header = false;
-	/* the last report timestamp */
-	static Time last_timestamp = 0;
-
-	if (!last_timestamp) last_timestamp = rec->timestamp;
+	if (!report.last_written) report.last_written = rec->timestamp;
 
 	if (!report.silent) {
-		if (!displayed_header) { /* Header */
+		if (!report.header) { /* Header */
 			fprintf(report.fp, "\n"
 				" Server Time : Diff    : Info\n"
 				"-----------------------------\n");
-			displayed_header = true;
+			report.header = true;
 		}
-		fprintf(report.fp, "%10lums : %5lums : %s", rec->timestamp, rec->timestamp - last_timestamp, rec->message);
+		fprintf(report.fp, "%10lums : %5lums : %s", rec->timestamp, rec->timestamp - report.last_written, rec->message);
 	}
 	else {
 		if (rec->print_always)
 			fprintf(report.fp, "%s", rec->message);
 	}
-	last_timestamp = rec->timestamp;
+	report.last_written = rec->timestamp;
 }
 
 /**
@@ -148,14 +153,11 @@ static gint compare_records_by_time(const record_t* rec1, const record_t* rec2,
 
 static void add_message(Time timestamp, bool print_always, const char* format, va_list* ap)
 {
-	/* the last report timestamp */
-	static Time last_timestamp = 0;
-
 	if (timestamp == REPORT_LAST_TIMESTAMP) {
-		timestamp = last_timestamp;
+		timestamp = report.last_added;
 	}
-	else if (last_timestamp == 0) {
-		last_timestamp = timestamp;
+	else if (report.last_added == 0) {
+		report.last_added = timestamp;
 	}
 
 	record_t* rec = g_slice_new(record_t);
@@ -170,27 +172,33 @@ static void add_message(Time timestamp, bool print_always, const char* format, v
 	rec->timestamp = timestamp;
 	rec->print_always = print_always;
 	g_queue_push_tail(&report.messages, rec);
-	last_timestamp = timestamp;
+	report.last_added = timestamp;
 }
 
 /*
  * Public API implementation.
  */
 
-void report_init(const char* filename)
+bool report_init(const char* filename)
 {
 	g_queue_init(&report.messages);
+	/* the report can be initialized again for the next session in daemon mode */
+	report.fp_owner = false;
+	report.silent = false;
+	report.header = false;
+	report.last_written = 0;
+	report.last_added = 0;
+	report.fp = stdout;
 	if (filename) {
-		report.fp = fopen(filename, "w");
-		if (!report.fp) {
+		FILE* fp = fopen(filename, "w");
+		if (!fp) {
 			fprintf(stderr, "Error while creating report file %s (%s)\n", filename, strerror(errno));
-			exit (-1);
+			return false;
 		}
+		report.fp = fp;
 		report.fp_owner = true;
 	}
-	else {
-		report.fp = stdout;
-	}
+	return true;
 }
 
 
@@ -62,8 +62,9 @@
  *
  * @param[in] filename   the report filename. Standard output is used
  *                       if the filename is NULL.
+ * @return               true if the report file was created.
  */
-void report_init(const char* filename);
+bool report_init(const char* filename);
 
 
 /**
@@ -36,6 +36,7 @@
 #include <limits.h>
 #include <stdbool.h>
 #include <sys/time.h>
+#include <time.h>
 
 #include <glib.h>
 
@@ -61,11 +62,21 @@ typedef struct {
 
 	/* timestamp of the last processed event */
 	struct timeval last_timestamp;
+
+	/* injected events waiting for their echo (injection_t) */
+	GQueue injections;
+
+	/* true if any events were scheduled */
+	bool used;
 } scheduler_t;
 
+/* the time injected events wait for their echo (nsecs) */
+#define SCHEDULER_ECHO_TIMEOUT	1000000000ULL
+
 
 static scheduler_t scheduler = {
 		.display = NULL,
+		.used = false,
 		.last_timestamp = {
 				.tv_sec = 0,
 				.tv_usec = 0,
@@ -79,6 +90,67 @@ static void event_free(event_t* event, void* __attribute__((unused)) data)
 }
 
 
+static void injection_free(injection_t* injection, void* __attribute__((unused)) data)
+{
+	g_slice_free(injection_t, injection);
+}
+
+
+/**
+ * Retrieves the monotonic clock time.
+ *
+ * @return   the current time (nsecs).
+ */
+static uint64_t get_monotonic_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+/**
+ * Removes the injected events which did not get echo in time.
+ *
+ * @param[in] now   the current time (nsecs, monotonic clock).
+ */
+static void injection_expire(uint64_t now)
+{
+	injection_t* injection;
+	while ((injection = g_queue_peek_head(&scheduler.injections)) && now - injection->sent > SCHEDULER_ECHO_TIMEOUT) {
+		injection_free(g_queue_pop_head(&scheduler.injections), NULL);
+	}
+}
+
+
+/**
+ * Stores injected event to match it with its echo.
+ *
+ * @param[in] event      the injected event.
+ * @param[in] scheduled  the scheduled injection time.
+ */
+static void injection_add(event_t* event, struct timeval* scheduled)
+{
+	static const int types[][2] = {
+			[SCHEDULER_EVENT_BUTTON] = {ButtonRelease, ButtonPress},
+			[SCHEDULER_EVENT_KEY] = {KeyRelease, KeyPress},
+			[SCHEDULER_EVENT_MOTION] = {MotionNotify, MotionNotify},
+	};
+	struct timeval now, diff;
+	gettimeofday(&now, NULL);
+	timersub(&now, scheduled, &diff);
+
+	injection_t* injection = g_slice_new(injection_t);
+	injection->type = types[event->type][event->param2 ? 1 : 0];
+	injection->detail = event->type == SCHEDULER_EVENT_MOTION ? 0 : event->param1;
+	injection->queued = diff.tv_sec * 1000000 + diff.tv_usec;
+	injection->sent = get_monotonic_time();
+
+	injection_expire(injection->sent);
+	g_queue_push_tail(&scheduler.injections, injection);
+}
+
+
 /**
  * Emulates user input event.
  *
@@ -114,6 +186,8 @@ static void fake_event(event_t* event)
 			break;
 		}
 	}
+	/* flush every event, so the echo delay doesn't include the time spent in output buffer */
+	XFlush(scheduler.display);
 }
 
 
@@ -126,13 +200,20 @@ static void fake_event(event_t* event)
 void scheduler_init(Display* display)
 {
 	scheduler.display = display;
+	scheduler.used = false;
+	/* the scheduling starts from the first processing of this session */
+	timerclear(&scheduler.last_timestamp);
 	g_queue_init(&scheduler.events);
+	g_queue_init(&scheduler.injections);
 }
 
 
 void scheduler_fini()
 {
 	g_queue_foreach(&scheduler.events, (GFunc)event_free, NULL);
+	g_queue_clear(&scheduler.events);
+	g_queue_foreach(&scheduler.injections, (GFunc)injection_free, NULL);
+	g_queue_clear(&scheduler.injections);
 }
 
 
@@ -146,6 +227,7 @@ event_t* scheduler_add_event(int type, XDevice* device, int param1, int param2,
 	event->delay = delay;
 	event->naxes = naxes;
 	g_queue_push_tail(&scheduler.events, event);
+	scheduler.used = true;
 	return event;
 }
 
@@ -159,14 +241,17 @@ int scheduler_process(struct timeval* timestamp)
 	event_t* event;
 	while ( (event = g_queue_peek_head(&scheduler.events)) &&
 			check_timeval_timeout(&scheduler.last_timestamp, timestamp, event->delay) ) {
-		fake_event(event);
-		g_queue_pop_head(&scheduler.events);
-
 		struct timeval delay = {
 		    .tv_usec = event->delay * 1000,
 		};
 		timeradd(&scheduler.last_timestamp, &delay, &scheduler.last_timestamp);
 
+		/* store the injection before sending the event, as its echo can be
+		 * recorded before the flush returns */
+		injection_add(event, &scheduler.last_timestamp);
+		fake_event(event);
+		g_queue_pop_head(&scheduler.events);
+
 		event_free(event, NULL);
 	}
 	if (!event) return 0;
@@ -177,3 +262,40 @@ int scheduler_process(struct timeval* timestamp)
 }
 
 
+bool scheduler_used()
+{
+	return scheduler.used;
+}
+
+
+bool scheduler_done()
+{
+	injection_expire(get_monotonic_time());
+	return scheduler.used && g_queue_is_empty(&scheduler.events) && g_queue_is_empty(&scheduler.injections);
+}
+
+
+bool scheduler_match_injection(int type, int detail, injection_t* injection)
+{
+	injection_expire(get_monotonic_time());
+
+	/* skip the motion injections without echo preceding button or key injection */
+	GList* node = scheduler.injections.head;
+	if (type != MotionNotify) {
+		while (node && ((injection_t*)node->data)->type == MotionNotify) node = node->next;
+	}
+	if (!node) return false;
+
+	injection_t* head = node->data;
+	if (head->type != type || head->detail != detail) return false;
+
+	/* the skipped motions were processed by server before the matched event */
+	while (g_queue_peek_head(&scheduler.injections) != head) {
+		injection_free(g_queue_pop_head(&scheduler.injections), NULL);
+	}
+	*injection = *head;
+	injection_free(g_queue_pop_head(&scheduler.injections), NULL);
+	return true;
+}
+
+
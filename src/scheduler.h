@@ -42,6 +42,9 @@
 #ifndef _SCHEDULER_H_
 #define _SCHEDULER_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 /**
  * The input event types.
  */
@@ -79,6 +82,24 @@ typedef struct event_t {
 } event_t;
 
 
+/**
+ * Injected input event, waiting for its echo from the server.
+ */
+typedef struct {
+	/* the core event type of the echo (KeyPress, ButtonRelease, MotionNotify...) */
+	int type;
+
+	/* the key code or button number, 0 for motion events */
+	int detail;
+
+	/* the delay between the scheduled and actual injection time (in microseconds) */
+	int queued;
+
+	/* the time the event was flushed to the server (nsecs, monotonic clock) */
+	uint64_t sent;
+} injection_t;
+
+
 /**
  * Initializes scheduler.
  *
@@ -122,4 +143,37 @@ event_t* scheduler_add_event(int type, XDevice* device, int param1, int param2,
 int scheduler_process(struct timeval* timestamp);
 
 
+/**
+ * Matches recorded input event with the oldest injected event.
+ *
+ * The server processes injected events in order, so a recorded event
+ * is the echo of an injected event only if it matches the oldest injected
+ * event waiting for its echo. Injected events without echo (motion to
+ * the current pointer location) are discarded when a later button or key
+ * injection gets its echo, or after a timeout.
+ * @param[in] type         the recorded event type.
+ * @param[in] detail       the recorded key code or button number.
+ * @param[out] injection   the matched injected event.
+ * @return                 true if the recorded event was injected by xresponse.
+ */
+bool scheduler_match_injection(int type, int detail, injection_t* injection);
+
+
+/**
+ * Checks if any events have been scheduled.
+ *
+ * @return   true if events were scheduled.
+ */
+bool scheduler_used();
+
+
+/**
+ * Checks if all scheduled events have been injected and recorded.
+ *
+ * @return   true if events were scheduled and all of them have been injected
+ *           and matched with their echo (or expired).
+ */
+bool scheduler_done();
+
+
 #endif
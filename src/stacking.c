@@ -0,0 +1,561 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+
+#include "stacking.h"
+#include "xresponse.h"
+
+/**
+ * Top level window data.
+ */
+typedef struct {
+	/* the window id */
+	Window window;
+	/* the window geometry (relative to the root window) */
+	int x, y, width, height, border;
+	/* true if the window is mapped */
+	bool mapped;
+	/* true if the window is InputOnly window, which doesn't draw anything */
+	bool input_only;
+	/* the pending window attributes request */
+	xcb_get_window_attributes_cookie_t attributes;
+	bool attributes_requested;
+	/* the pending window geometry request */
+	xcb_get_geometry_cookie_t geometry;
+	bool geometry_requested;
+} toplevel_t;
+
+
+/**
+ * Damaged rectangle attributed to a top level window.
+ */
+typedef struct {
+	toplevel_t* toplevel;
+	Rectangle rect;
+} piece_t;
+
+
+/**
+ * Stacking order index data.
+ */
+typedef struct {
+	/* the connected display */
+	Display* display;
+	/* the connection to the X server */
+	xcb_connection_t* connection;
+	/* the root window */
+	Window root;
+	/* the top level windows in stacking order, from bottom to top (toplevel_t) */
+	GQueue windows;
+	/* the stacking order links, indexed by window id */
+	GHashTable* index;
+	/* the rectangles not yet attributed to any window (Rectangle) */
+	GArray* remaining;
+	/* the rectangles left after subtracting the current window (Rectangle) */
+	GArray* uncovered;
+	/* the attributed rectangles (piece_t) */
+	GArray* pieces;
+	/* the attributed damage of the current root damage frame (XDamageNotifyEvent) */
+	GArray* frame;
+	/* the windows whose frame has been closed while dispatching the frame damage */
+	GHashTable* closed;
+	/* the initial window tree request */
+	xcb_query_tree_cookie_t tree;
+	bool tree_requested;
+} stacking_t;
+
+static stacking_t stacking = {
+		.display = NULL,
+		.connection = NULL,
+		.root = None,
+		.index = NULL,
+		.remaining = NULL,
+		.uncovered = NULL,
+		.pieces = NULL,
+		.frame = NULL,
+		.closed = NULL,
+		.tree_requested = false,
+};
+
+
+static void toplevel_free(toplevel_t* toplevel)
+{
+	if (toplevel->attributes_requested) {
+		xcb_discard_reply(stacking.connection, toplevel->attributes.sequence);
+	}
+	if (toplevel->geometry_requested) {
+		xcb_discard_reply(stacking.connection, toplevel->geometry.sequence);
+	}
+	g_slice_free(toplevel_t, toplevel);
+}
+
+
+/**
+ * Finds the stacking order link of the specified window.
+ */
+static GList* toplevel_find(Window window)
+{
+	return g_hash_table_lookup(stacking.index, (gconstpointer)window);
+}
+
+
+/**
+ * Adds new window to the top of the stacking order.
+ *
+ * The window class is requested asynchronously, as well as the geometry
+ * if requested.
+ * @param[in] window          the window.
+ * @param[in] query_geometry  true if the window geometry must be requested.
+ * @return                    the added window.
+ */
+static toplevel_t* toplevel_add(Window window, bool query_geometry)
+{
+	toplevel_t* toplevel = g_slice_new0(toplevel_t);
+	toplevel->window = window;
+	toplevel->attributes = xcb_get_window_attributes(stacking.connection, window);
+	toplevel->attributes_requested = true;
+	if (query_geometry) {
+		toplevel->geometry = xcb_get_geometry(stacking.connection, window);
+		toplevel->geometry_requested = true;
+	}
+	g_queue_push_tail(&stacking.windows, toplevel);
+	g_hash_table_insert(stacking.index, (gpointer)window, stacking.windows.tail);
+	return toplevel;
+}
+
+
+/**
+ * Removes window from the stacking order.
+ */
+static void toplevel_remove(Window window)
+{
+	GList* link = toplevel_find(window);
+	if (link) {
+		g_hash_table_remove(stacking.index, (gconstpointer)window);
+		toplevel_free(link->data);
+		g_queue_delete_link(&stacking.windows, link);
+	}
+}
+
+
+/**
+ * Moves window in the stacking order above the specified sibling.
+ *
+ * @param[in] link      the window link.
+ * @param[in] sibling   the sibling window or None to move the window to the bottom.
+ */
+static void toplevel_restack(GList* link, Window sibling)
+{
+	toplevel_t* toplevel = link->data;
+	GList* above = sibling == None ? NULL : toplevel_find(sibling);
+
+	if ((sibling != None && !above) || above == link) return;
+
+	g_queue_delete_link(&stacking.windows, link);
+	if (above) {
+		g_queue_insert_after(&stacking.windows, above, toplevel);
+		link = above->next;
+	}
+	else {
+		g_queue_push_head(&stacking.windows, toplevel);
+		link = stacking.windows.head;
+	}
+	g_hash_table_insert(stacking.index, (gpointer)toplevel->window, link);
+}
+
+
+/**
+ * Processes the pending window attribute and geometry replies.
+ *
+ * The replies are processed only if they have already arrived, so the
+ * damage attribution doesn't wait for server round trips. Until then the
+ * previously known (or unknown) attributes and geometry are used.
+ */
+static void toplevel_update(toplevel_t* toplevel)
+{
+	xcb_generic_error_t* error = NULL;
+
+	if (toplevel->attributes_requested) {
+		xcb_get_window_attributes_reply_t* reply = NULL;
+		if (!xcb_poll_for_reply(stacking.connection, toplevel->attributes.sequence, (void**)&reply, &error)) {
+			/* the replies arrive in request order */
+			return;
+		}
+		toplevel->attributes_requested = false;
+		free(error);
+		error = NULL;
+		if (reply) {
+			toplevel->input_only = reply->_class == XCB_WINDOW_CLASS_INPUT_ONLY;
+			toplevel->mapped = reply->map_state != XCB_MAP_STATE_UNMAPPED;
+			free(reply);
+		}
+	}
+	if (toplevel->geometry_requested) {
+		xcb_get_geometry_reply_t* reply = NULL;
+		if (!xcb_poll_for_reply(stacking.connection, toplevel->geometry.sequence, (void**)&reply, &error)) {
+			return;
+		}
+		toplevel->geometry_requested = false;
+		free(error);
+		if (reply) {
+			toplevel->x = reply->x;
+			toplevel->y = reply->y;
+			toplevel->width = reply->width;
+			toplevel->height = reply->height;
+			toplevel->border = reply->border_width;
+			free(reply);
+		}
+	}
+}
+
+
+/**
+ * Processes the initial window tree reply if it has arrived.
+ *
+ * The reply precedes the events generated after the request, so processing
+ * it before the events keeps the stacking order consistent.
+ */
+static void stacking_update_tree()
+{
+	xcb_query_tree_reply_t* reply = NULL;
+	xcb_generic_error_t* error = NULL;
+	int i, n_children;
+
+	if (!stacking.tree_requested) return;
+	if (!xcb_poll_for_reply(stacking.connection, stacking.tree.sequence, (void**)&reply, &error)) return;
+	stacking.tree_requested = false;
+	free(error);
+	if (!reply) return;
+
+	/* the children are returned in stacking order, bottom first */
+	xcb_window_t* children = xcb_query_tree_children(reply);
+	n_children = xcb_query_tree_children_length(reply);
+	for (i = 0; i < n_children; i++) {
+		GList* link = toplevel_find(children[i]);
+		if (link) {
+			/* the window was added by an event preceding the reply */
+			toplevel_restack(link, ((toplevel_t*)stacking.windows.tail->data)->window);
+		}
+		else {
+			toplevel_add(children[i], true);
+		}
+	}
+	free(reply);
+	xcb_flush(stacking.connection);
+}
+
+
+/**
+ * Calculates intersection of two rectangles.
+ *
+ * @param[in] r1      the first rectangle.
+ * @param[in] r2      the second rectangle.
+ * @param[out] out    the intersection.
+ * @return            true if the rectangles intersect.
+ */
+static bool rect_intersect(const Rectangle* r1, const Rectangle* r2, Rectangle* out)
+{
+	int x1 = MAX(r1->x, r2->x);
+	int y1 = MAX(r1->y, r2->y);
+	int x2 = MIN(r1->x + r1->width, r2->x + r2->width);
+	int y2 = MIN(r1->y + r1->height, r2->y + r2->height);
+
+	if (x1 >= x2 || y1 >= y2) return false;
+
+	out->x = x1;
+	out->y = y1;
+	out->width = x2 - x1;
+	out->height = y2 - y1;
+	return true;
+}
+
+
+/**
+ * Adds the parts of a rectangle outside its intersection with another
+ * rectangle to the array.
+ *
+ * @param[in] rects   the target array.
+ * @param[in] rect    the rectangle.
+ * @param[in] clip    the intersection of the rectangle and other rectangle.
+ */
+static void rect_subtract(GArray* rects, const Rectangle* rect, const Rectangle* clip)
+{
+	Rectangle part;
+
+	/* the full width bands above and below the intersection */
+	if (clip->y > rect->y) {
+		part = (Rectangle){rect->x, rect->y, rect->width, clip->y - rect->y};
+		g_array_append_val(rects, part);
+	}
+	if (clip->y + clip->height < rect->y + rect->height) {
+		part = (Rectangle){rect->x, clip->y + clip->height, rect->width,
+				rect->y + rect->height - clip->y - clip->height};
+		g_array_append_val(rects, part);
+	}
+	/* the parts on the left and right sides of the intersection */
+	if (clip->x > rect->x) {
+		part = (Rectangle){rect->x, clip->y, clip->x - rect->x, clip->height};
+		g_array_append_val(rects, part);
+	}
+	if (clip->x + clip->width < rect->x + rect->width) {
+		part = (Rectangle){clip->x + clip->width, clip->y, rect->x + rect->width - clip->x - clip->width,
+				clip->height};
+		g_array_append_val(rects, part);
+	}
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+void stacking_init(Display* display)
+{
+	/* the index is shared by root damage attribution and input monitoring */
+	if (stacking.index) return;
+
+	stacking.display = display;
+	stacking.connection = XGetXCBConnection(display);
+	stacking.root = DefaultRootWindow(display);
+	g_queue_init(&stacking.windows);
+	stacking.index = g_hash_table_new(g_direct_hash, g_direct_equal);
+	stacking.remaining = g_array_new(FALSE, FALSE, sizeof(Rectangle));
+	stacking.uncovered = g_array_new(FALSE, FALSE, sizeof(Rectangle));
+	stacking.pieces = g_array_new(FALSE, FALSE, sizeof(piece_t));
+	stacking.frame = g_array_new(FALSE, FALSE, sizeof(XDamageNotifyEvent));
+	stacking.closed = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	/* the top level windows are added when the reply arrives */
+	stacking.tree = xcb_query_tree(stacking.connection, stacking.root);
+	stacking.tree_requested = true;
+	xcb_flush(stacking.connection);
+}
+
+
+void stacking_fini()
+{
+	if (stacking.index) {
+		if (stacking.tree_requested) {
+			xcb_discard_reply(stacking.connection, stacking.tree.sequence);
+			stacking.tree_requested = false;
+		}
+		g_queue_foreach(&stacking.windows, (GFunc)toplevel_free, NULL);
+		g_queue_clear(&stacking.windows);
+		g_hash_table_destroy(stacking.index);
+		stacking.index = NULL;
+		g_array_free(stacking.remaining, TRUE);
+		g_array_free(stacking.uncovered, TRUE);
+		g_array_free(stacking.pieces, TRUE);
+		g_array_free(stacking.frame, TRUE);
+		g_hash_table_destroy(stacking.closed);
+	}
+}
+
+
+void stacking_process_event(XEvent* ev)
+{
+	GList* link;
+	toplevel_t* toplevel;
+
+	if (!stacking.index) return;
+
+	stacking_update_tree();
+
+	switch (ev->type) {
+	case CreateNotify:
+		if (ev->xcreatewindow.parent == stacking.root) {
+			toplevel = toplevel_add(ev->xcreatewindow.window, false);
+			toplevel->x = ev->xcreatewindow.x;
+			toplevel->y = ev->xcreatewindow.y;
+			toplevel->width = ev->xcreatewindow.width;
+			toplevel->height = ev->xcreatewindow.height;
+			toplevel->border = ev->xcreatewindow.border_width;
+			xcb_flush(stacking.connection);
+		}
+		break;
+
+	case DestroyNotify:
+		toplevel_remove(ev->xdestroywindow.window);
+		break;
+
+	case ReparentNotify:
+		if (ev->xreparent.parent == stacking.root) {
+			if (!toplevel_find(ev->xreparent.window)) {
+				toplevel_add(ev->xreparent.window, true);
+				xcb_flush(stacking.connection);
+			}
+		}
+		else {
+			toplevel_remove(ev->xreparent.window);
+		}
+		break;
+
+	case MapNotify:
+	case UnmapNotify:
+		if ((link = toplevel_find(ev->xany.type == MapNotify ? ev->xmap.window : ev->xunmap.window))) {
+			toplevel = link->data;
+			toplevel_update(toplevel);
+			toplevel->mapped = ev->type == MapNotify;
+		}
+		break;
+
+	case ConfigureNotify:
+		if ((link = toplevel_find(ev->xconfigure.window))) {
+			toplevel = link->data;
+			/* the event carries more recent geometry than the pending reply */
+			if (toplevel->geometry_requested) {
+				xcb_discard_reply(stacking.connection, toplevel->geometry.sequence);
+				toplevel->geometry_requested = false;
+			}
+			toplevel->x = ev->xconfigure.x;
+			toplevel->y = ev->xconfigure.y;
+			toplevel->width = ev->xconfigure.width;
+			toplevel->height = ev->xconfigure.height;
+			toplevel->border = ev->xconfigure.border_width;
+			toplevel_restack(link, ev->xconfigure.above);
+		}
+		break;
+
+	case CirculateNotify:
+		if ((link = toplevel_find(ev->xcirculate.window))) {
+			if (ev->xcirculate.place == PlaceOnTop) {
+				toplevel_restack(link, ((toplevel_t*)stacking.windows.tail->data)->window);
+			}
+			else {
+				toplevel_restack(link, None);
+			}
+		}
+		break;
+	}
+}
+
+
+Window stacking_find_window(int x, int y)
+{
+	GList* link;
+
+	if (!stacking.index) return None;
+
+	stacking_update_tree();
+
+	for (link = stacking.windows.tail; link; link = link->prev) {
+		toplevel_t* toplevel = link->data;
+		toplevel_update(toplevel);
+		if (!toplevel->mapped || toplevel->input_only) continue;
+
+		if (x >= toplevel->x && x < toplevel->x + toplevel->width + toplevel->border * 2 &&
+				y >= toplevel->y && y < toplevel->y + toplevel->height + toplevel->border * 2) {
+			return toplevel->window;
+		}
+	}
+	return None;
+}
+
+
+void stacking_split_damage(XDamageNotifyEvent* dev, stacking_damage_handler_t handler)
+{
+	GList* link;
+	guint i;
+
+	if (!stacking.index) return;
+
+	stacking_update_tree();
+
+	Rectangle rect = {dev->area.x + dev->geometry.x, dev->area.y + dev->geometry.y, dev->area.width, dev->area.height};
+	g_array_set_size(stacking.remaining, 0);
+	g_array_set_size(stacking.pieces, 0);
+	g_array_append_val(stacking.remaining, rect);
+
+	/* attribute the damage to the topmost windows covering it */
+	for (link = stacking.windows.tail; link && stacking.remaining->len; link = link->prev) {
+		toplevel_t* toplevel = link->data;
+		toplevel_update(toplevel);
+		if (!toplevel->mapped || toplevel->input_only) continue;
+
+		Rectangle bounds = {toplevel->x, toplevel->y, toplevel->width + toplevel->border * 2,
+				toplevel->height + toplevel->border * 2};
+		g_array_set_size(stacking.uncovered, 0);
+		for (i = 0; i < stacking.remaining->len; i++) {
+			Rectangle* part = &g_array_index(stacking.remaining, Rectangle, i);
+			piece_t piece = {.toplevel = toplevel};
+			if (rect_intersect(part, &bounds, &piece.rect)) {
+				g_array_append_val(stacking.pieces, piece);
+				rect_subtract(stacking.uncovered, part, &piece.rect);
+			}
+			else {
+				g_array_append_val(stacking.uncovered, *part);
+			}
+		}
+		GArray* swap = stacking.remaining;
+		stacking.remaining = stacking.uncovered;
+		stacking.uncovered = swap;
+	}
+
+	for (i = 0; i < stacking.pieces->len; i++) {
+		piece_t* piece = &g_array_index(stacking.pieces, piece_t, i);
+		XDamageNotifyEvent event = *dev;
+		int x = piece->toplevel->x + piece->toplevel->border;
+		int y = piece->toplevel->y + piece->toplevel->border;
+
+		event.drawable = piece->toplevel->window;
+		event.geometry.x = x;
+		event.geometry.y = y;
+		event.geometry.width = piece->toplevel->width;
+		event.geometry.height = piece->toplevel->height;
+		event.area.x = piece->rect.x - x;
+		event.area.y = piece->rect.y - y;
+		event.area.width = piece->rect.width;
+		event.area.height = piece->rect.height;
+		g_array_append_val(stacking.frame, event);
+	}
+	/* the damage is dispatched when the frame is finished */
+	if (dev->more) return;
+
+	/* the frame of every window is finished with its last part */
+	g_hash_table_remove_all(stacking.closed);
+	for (i = stacking.frame->len; i > 0; i--) {
+		XDamageNotifyEvent* event = &g_array_index(stacking.frame, XDamageNotifyEvent, i - 1);
+		event->more = g_hash_table_contains(stacking.closed, (gconstpointer)event->drawable);
+		if (!event->more) g_hash_table_add(stacking.closed, (gpointer)event->drawable);
+	}
+	for (i = 0; i < stacking.frame->len; i++) {
+		handler(&g_array_index(stacking.frame, XDamageNotifyEvent, i));
+	}
+	g_array_set_size(stacking.frame, 0);
+}
@@ -0,0 +1,108 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file stacking.h
+ * Client side stacking order and geometry index of top level windows.
+ *
+ * stacking.c|h files keep the stacking order, geometry and map state of
+ * the root window children up to date from Create/Destroy/Configure/Map/
+ * Unmap/Reparent/Circulate notifications. This allows to monitor the
+ * whole screen with a single damage object on the root window and
+ * attribute the damaged rectangles to the top level windows on the
+ * client side, and to find the windows at the user input coordinates
+ * without querying the server.
+ */
+
+#ifndef _STACKING_H_
+#define _STACKING_H_
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+
+/**
+ * Damage handler.
+ *
+ * @param[in] dev   the damage event.
+ */
+typedef void (*stacking_damage_handler_t)(XDamageNotifyEvent* dev);
+
+/**
+ * Initializes the stacking order index with the current root window children.
+ *
+ * The root window children are requested asynchronously and added when the
+ * reply arrives. Does nothing if the index is already initialized.
+ * @param[in] display   the connected display.
+ */
+void stacking_init(Display* display);
+
+
+/**
+ * Releases resources allocated by the stacking order index.
+ */
+void stacking_fini();
+
+
+/**
+ * Updates the stacking order index from X event.
+ *
+ * @param[in] ev   the event.
+ */
+void stacking_process_event(XEvent* ev);
+
+
+/**
+ * Finds the topmost visible top level window at the specified position.
+ *
+ * @param[in] x   the x coordinate relative to the root window.
+ * @param[in] y   the y coordinate relative to the root window.
+ * @return        the top level window or None if the position is not covered
+ *                by any window (or the index is not initialized).
+ */
+Window stacking_find_window(int x, int y);
+
+
+/**
+ * Splits root window damage between the visible top level windows.
+ *
+ * The damaged rectangle is hit-tested against the mapped top level windows
+ * in the stacking order, starting from the top. Every part of the rectangle
+ * is attributed to the topmost window covering it and passed to the handler
+ * as a damage event of that window. Parts not covered by any window are
+ * ignored. The attributed damage is passed to the handler when the root
+ * damage frame is finished, with the last part of every window finishing
+ * the frame of that window.
+ * @param[in] dev       the root window damage event.
+ * @param[in] handler   the handler of the attributed damage.
+ */
+void stacking_split_damage(XDamageNotifyEvent* dev, stacking_damage_handler_t handler);
+
+#endif
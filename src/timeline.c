@@ -0,0 +1,275 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include "timeline.h"
+#include "region.h"
+#include "report.h"
+
+/**
+ * The summarized timeline fields.
+ */
+enum {
+	TIMELINE_DELIVERY,
+	TIMELINE_FIRST,
+	TIMELINE_LAST,
+	TIMELINE_SETTLE,
+	TIMELINE_FRAMES,
+	TIMELINE_AREA,
+	TIMELINE_FIELDS
+};
+
+/**
+ * The first and last damage of a window during an interaction.
+ */
+typedef struct {
+	Window window;
+	Time first;
+	Time last;
+	/* the number of frames of the window damage object */
+	unsigned int frames;
+} timeline_window_t;
+
+/**
+ * Response timeline data structure.
+ */
+typedef struct {
+	/* the interaction record file */
+	FILE* fp;
+
+	/* true if an interaction is in progress */
+	bool active;
+	/* the server timestamp of the user action */
+	Time receipt;
+	/* the injection delays (usecs), -1 if the action was not injected */
+	int queued;
+	int delivery;
+	/* the first and last damage timestamps, 0 if no damage was received */
+	Time first;
+	Time last;
+	/* the number of frames of the most frequently updated window */
+	unsigned int frames;
+	/* the damaged region */
+	region_t damage;
+	/* the damaged windows in the order of their first damage (timeline_window_t) */
+	GArray* windows;
+
+	/* the collected field values of all interactions (double) */
+	GArray* values[TIMELINE_FIELDS];
+} timeline_t;
+
+static timeline_t timeline = {
+		.fp = NULL,
+		.active = false,
+		.windows = NULL,
+};
+
+/* the summarized field names */
+static const char* field_names[TIMELINE_FIELDS] = {
+		[TIMELINE_DELIVERY] = "delivery (ms)",
+		[TIMELINE_FIRST] = "first damage (ms)",
+		[TIMELINE_LAST] = "last damage (ms)",
+		[TIMELINE_SETTLE] = "settle (ms)",
+		[TIMELINE_FRAMES] = "frames",
+		[TIMELINE_AREA] = "area (px)",
+};
+
+
+/**
+ * Stores the field value of the finished interaction.
+ *
+ * @param[in] field   the field (TIMELINE_* enum).
+ * @param[in] value   the field value.
+ */
+static void add_value(int field, double value)
+{
+	g_array_append_val(timeline.values[field], value);
+}
+
+
+static gint compare_values(const double* value1, const double* value2)
+{
+	return *value1 < *value2 ? -1 : *value1 > *value2;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool timeline_init(const char* filename)
+{
+	timeline.fp = fopen(filename, "w");
+	if (!timeline.fp) return false;
+
+	fprintf(timeline.fp, "# action\treceipt\tscheduled\tinject\tfirst\tlast\tsettle\tframes\tarea\twindows\n");
+
+	region_init(&timeline.damage);
+	timeline.windows = g_array_new(FALSE, FALSE, sizeof(timeline_window_t));
+	int i;
+	for (i = 0; i < TIMELINE_FIELDS; i++) {
+		timeline.values[i] = g_array_new(FALSE, FALSE, sizeof(double));
+	}
+	return true;
+}
+
+
+void timeline_fini()
+{
+	if (!timeline.fp) return;
+
+	fclose(timeline.fp);
+	timeline.fp = NULL;
+	timeline.active = false;
+	region_free(&timeline.damage);
+	g_array_free(timeline.windows, TRUE);
+	int i;
+	for (i = 0; i < TIMELINE_FIELDS; i++) {
+		g_array_free(timeline.values[i], TRUE);
+	}
+}
+
+
+void timeline_start(Time receipt)
+{
+	if (!timeline.fp) return;
+
+	timeline.active = true;
+	timeline.receipt = receipt;
+	timeline.queued = -1;
+	timeline.delivery = -1;
+	timeline.first = 0;
+	timeline.last = 0;
+	timeline.frames = 0;
+	region_clear(&timeline.damage);
+	g_array_set_size(timeline.windows, 0);
+}
+
+
+void timeline_set_delivery(int queued, int delivery)
+{
+	timeline.queued = queued;
+	timeline.delivery = delivery;
+}
+
+
+void timeline_register_damage(XDamageNotifyEvent* dev)
+{
+	if (!timeline.fp || !timeline.active || dev->timestamp < timeline.receipt) return;
+
+	if (!timeline.first) timeline.first = dev->timestamp;
+	if (dev->timestamp > timeline.last) timeline.last = dev->timestamp;
+	region_add(&timeline.damage, dev->area.x + dev->geometry.x, dev->area.y + dev->geometry.y,
+			dev->area.width, dev->area.height);
+
+	/* an interaction usually damages only a few windows */
+	timeline_window_t* win = NULL;
+	guint i;
+	for (i = 0; i < timeline.windows->len; i++) {
+		if (g_array_index(timeline.windows, timeline_window_t, i).window == dev->drawable) {
+			win = &g_array_index(timeline.windows, timeline_window_t, i);
+			break;
+		}
+	}
+	if (!win) {
+		timeline_window_t add = {.window = dev->drawable, .first = dev->timestamp, .last = dev->timestamp};
+		g_array_append_val(timeline.windows, add);
+		win = &g_array_index(timeline.windows, timeline_window_t, timeline.windows->len - 1);
+	}
+	if (dev->timestamp > win->last) win->last = dev->timestamp;
+
+	/* the frames are counted per damage object, so windows updated in the same frame don't add up */
+	if (!dev->more && ++win->frames > timeline.frames) timeline.frames = win->frames;
+}
+
+
+void timeline_finish(const char* action, long settle)
+{
+	if (!timeline.fp || !timeline.active) return;
+	timeline.active = false;
+
+	unsigned long long area = region_area(&timeline.damage);
+
+	fprintf(timeline.fp, "%s\t%lu\t", action, timeline.receipt);
+	if (timeline.delivery >= 0) {
+		fprintf(timeline.fp, "%.1f\t%.1f\t", -(timeline.queued + timeline.delivery) / 1000.0, -timeline.delivery / 1000.0);
+		add_value(TIMELINE_DELIVERY, timeline.delivery / 1000.0);
+	}
+	else {
+		fprintf(timeline.fp, "-\t-\t");
+	}
+	if (timeline.first) {
+		fprintf(timeline.fp, "%ld\t%ld\t", (long)(timeline.first - timeline.receipt), (long)(timeline.last - timeline.receipt));
+		add_value(TIMELINE_FIRST, timeline.first - timeline.receipt);
+		add_value(TIMELINE_LAST, timeline.last - timeline.receipt);
+	}
+	else {
+		fprintf(timeline.fp, "-\t-\t");
+	}
+	fprintf(timeline.fp, "%ld\t%u\t%llu\t", settle, timeline.frames, area);
+	add_value(TIMELINE_SETTLE, settle);
+	add_value(TIMELINE_FRAMES, timeline.frames);
+	add_value(TIMELINE_AREA, area);
+
+	/* the windows are listed as window:first:last */
+	guint i;
+	for (i = 0; i < timeline.windows->len; i++) {
+		timeline_window_t* win = &g_array_index(timeline.windows, timeline_window_t, i);
+		fprintf(timeline.fp, "%s0x%lx:%ld:%ld", i ? " " : "", win->window, (long)(win->first - timeline.receipt),
+				(long)(win->last - timeline.receipt));
+	}
+	fprintf(timeline.fp, "\n");
+	fflush(timeline.fp);
+}
+
+
+void timeline_report()
+{
+	if (!timeline.fp || !timeline.values[TIMELINE_SETTLE]->len) return;
+
+	report_add_message_forced("Response timeline over %u interactions:\n", timeline.values[TIMELINE_SETTLE]->len);
+	report_add_message_forced("\t%32s %12s %12s %12s\n", "", "min", "median", "max");
+	int i;
+	for (i = 0; i < TIMELINE_FIELDS; i++) {
+		GArray* values = timeline.values[i];
+		if (!values->len) continue;
+		g_array_sort(values, (GCompareFunc)compare_values);
+		report_add_message_forced("\t%32s %12.1f %12.1f %12.1f\n", field_names[i], g_array_index(values, double, 0),
+				g_array_index(values, double, values->len / 2), g_array_index(values, double, values->len - 1));
+	}
+	report_add_message_forced("\n");
+}
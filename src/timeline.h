@@ -0,0 +1,107 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file timeline.h
+ * Per interaction response timeline.
+ *
+ * timeline.c|h files collect the response timeline of every user action in
+ * response monitoring mode - the input injection and server receipt times,
+ * the first damage of every window, the last damage, the settle time, the
+ * number of frames (of the most frequently updated window) and the covered area. The timelines are written as
+ * tab separated records, one per interaction, and summarized at exit.
+ */
+
+#ifndef _TIMELINE_H_
+#define _TIMELINE_H_
+
+#include <stdbool.h>
+
+#include <X11/Xlib.h>
+#include <X11/extensions/Xdamage.h>
+
+/**
+ * Initializes the response timeline collection.
+ *
+ * @param[in] filename   the interaction record file name.
+ * @return               true if the record file was opened.
+ */
+bool timeline_init(const char* filename);
+
+
+/**
+ * Releases resources allocated by the response timeline collection.
+ */
+void timeline_fini();
+
+
+/**
+ * Starts the timeline of a new interaction.
+ *
+ * @param[in] receipt   the server timestamp of the user action.
+ */
+void timeline_start(Time receipt);
+
+
+/**
+ * Sets the input injection times of the current interaction.
+ *
+ * @param[in] queued     the delay between scheduled and actual injection (usecs).
+ * @param[in] delivery   the delay between injection and server receipt (usecs).
+ */
+void timeline_set_delivery(int queued, int delivery);
+
+
+/**
+ * Registers damage of a monitored window in the current interaction.
+ *
+ * @param[in] dev   the damage event.
+ */
+void timeline_register_damage(XDamageNotifyEvent* dev);
+
+
+/**
+ * Finishes the current interaction and writes its record.
+ *
+ * @param[in] action   the user action description.
+ * @param[in] settle   the time from the user action to the end of response
+ *                     monitoring or to the settling of monitored areas (msecs).
+ */
+void timeline_finish(const char* action, long settle);
+
+
+/**
+ * Reports the minimum, median and maximum of the timeline fields
+ * over all interactions.
+ */
+void timeline_report();
+
+#endif
@@ -0,0 +1,348 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <glib.h>
+
+#include "visual.h"
+#include "content.h"
+#include "area.h"
+#include "report.h"
+
+/* the histogram bins of every pixel byte */
+#define VISUAL_BINS			8
+
+/* the shift converting pixel byte value to histogram bin */
+#define VISUAL_BIN_SHIFT	5
+
+/* the histogram data of a tile - every byte of 32 bit pixel has its own histogram */
+#define VISUAL_TILE_BINS	(4 * VISUAL_BINS)
+
+/**
+ * Sampled frame.
+ */
+typedef struct {
+	/* the sampling time relative to the user action (msecs) */
+	int time;
+	/* the tile histograms, rows * columns * VISUAL_TILE_BINS */
+	uint16_t* histograms;
+} visual_frame_t;
+
+/**
+ * Visual completeness measurement data.
+ */
+typedef struct {
+	/* the sampled region in screen */
+	Rectangle rect;
+	/* the region size in tiles */
+	int columns;
+	int rows;
+	/* the number of histogram bins in a frame */
+	size_t bins;
+	/* the minimum interval between sampled frames (msecs) */
+	int interval;
+	/* the root window */
+	Window root;
+	/* the histogram storage of all frames, allocated at initialization */
+	uint16_t* storage;
+	/* the frame before user action */
+	visual_frame_t initial;
+	/* the frame ring */
+	visual_frame_t ring[VISUAL_RING_SIZE];
+	/* the next ring slot */
+	unsigned int head;
+	/* the number of frames in ring */
+	unsigned int count;
+	/* the number of frames overwritten in ring */
+	unsigned int dropped;
+	/* the local time of the user action */
+	struct timeval action;
+	/* the local time of the last sampled frame */
+	struct timeval last_sample;
+	/* true if frames are sampled */
+	bool active;
+	/* true if the region was damaged after the last sampled frame */
+	bool pending;
+} visual_t;
+
+static visual_t visual = {
+		.storage = NULL,
+		.active = false,
+		.pending = false,
+};
+
+
+/**
+ * Returns the time difference in milliseconds.
+ */
+static int timeval_diff_ms(const struct timeval* end, const struct timeval* start)
+{
+	return (end->tv_sec - start->tv_sec) * 1000 + (end->tv_usec - start->tv_usec) / 1000;
+}
+
+
+/**
+ * Samples the region into frame.
+ *
+ * @param[in] frame   the frame to sample into.
+ * @param[in] now     the current local time.
+ * @return            true if the region was sampled.
+ */
+static bool visual_sample(visual_frame_t* frame, const struct timeval* now)
+{
+	Rectangle* rect = &visual.rect;
+	int depth, bytes_per_line;
+	const uint8_t* pixels = content_fetch(visual.root, rect->x, rect->y, rect->width, rect->height, &depth,
+			&bytes_per_line);
+	if (!pixels || bytes_per_line < rect->width * 4) return false;
+
+	memset(frame->histograms, 0, visual.bins * sizeof(uint16_t));
+	int line, x;
+	for (line = 0; line < rect->height; line++) {
+		const uint8_t* data = pixels + line * bytes_per_line;
+		uint16_t* row = frame->histograms + (line / CONTENT_TILE_SIZE) * visual.columns * VISUAL_TILE_BINS;
+		for (x = 0; x < rect->width; x++) {
+			uint16_t* tile = row + (x / CONTENT_TILE_SIZE) * VISUAL_TILE_BINS;
+			tile[data[0] >> VISUAL_BIN_SHIFT]++;
+			tile[VISUAL_BINS + (data[1] >> VISUAL_BIN_SHIFT)]++;
+			tile[VISUAL_BINS * 2 + (data[2] >> VISUAL_BIN_SHIFT)]++;
+			tile[VISUAL_BINS * 3 + (data[3] >> VISUAL_BIN_SHIFT)]++;
+			data += 4;
+		}
+	}
+	frame->time = timeval_diff_ms(now, &visual.action);
+	visual.last_sample = *now;
+	visual.pending = false;
+	return true;
+}
+
+
+/**
+ * Samples the next frame into the frame ring.
+ *
+ * When the ring is full the oldest frame is overwritten.
+ * @param[in] now   the current local time.
+ */
+static void visual_sample_next(const struct timeval* now)
+{
+	if (visual_sample(&visual.ring[visual.head], now)) {
+		visual.head = (visual.head + 1) % VISUAL_RING_SIZE;
+		if (visual.count < VISUAL_RING_SIZE) visual.count++;
+		else visual.dropped++;
+	}
+}
+
+
+/**
+ * Calculates the distance of two frames as the sum of the tile
+ * histogram differences.
+ *
+ * @param[in] frame1   the first frame.
+ * @param[in] frame2   the second frame.
+ * @return             the frame distance.
+ */
+static unsigned long long visual_distance(const visual_frame_t* frame1, const visual_frame_t* frame2)
+{
+	const uint16_t* __restrict h1 = frame1->histograms;
+	const uint16_t* __restrict h2 = frame2->histograms;
+	unsigned long long sum = 0;
+	size_t i;
+	for (i = 0; i < visual.bins; i++) {
+		int diff = h1[i] - h2[i];
+		sum += diff < 0 ? -diff : diff;
+	}
+	return sum;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+bool visual_init(Display* dpy, const char* text)
+{
+	char** fields = g_strsplit(text, ",", 2);
+	bool rc = false;
+	int fps = fields[0] ? atoi(fields[0]) : 0;
+	if (fps <= 0) fps = VISUAL_DEFAULT_FPS;
+
+	if (fields[0] && fields[1]) {
+		area_t* area;
+		if (sscanf(fields[1], "%dx%d+%d+%d", &visual.rect.width, &visual.rect.height, &visual.rect.x,
+				&visual.rect.y) != 4) {
+			if (!(area = area_find(fields[1]))) {
+				fprintf(stderr, "*** unknown region '%s'\n", fields[1]);
+				goto out;
+			}
+			visual.rect = area->rect;
+		}
+	}
+	else {
+		visual.rect.x = 0;
+		visual.rect.y = 0;
+		visual.rect.width = DisplayWidth(dpy, DefaultScreen(dpy));
+		visual.rect.height = DisplayHeight(dpy, DefaultScreen(dpy));
+	}
+	if (visual.rect.width <= 0 || visual.rect.height <= 0) {
+		fprintf(stderr, "*** empty speed index region\n");
+		goto out;
+	}
+	if (DefaultDepth(dpy, DefaultScreen(dpy)) < 24) {
+		fprintf(stderr, "*** speed index requires 24 or 32 bit screen depth\n");
+		goto out;
+	}
+	if (!content_init(dpy, false)) {
+		fprintf(stderr, "*** speed index requires MIT-SHM extension\n");
+		goto out;
+	}
+
+	visual.interval = 1000 / fps;
+	visual.columns = (visual.rect.width + CONTENT_TILE_SIZE - 1) / CONTENT_TILE_SIZE;
+	visual.rows = (visual.rect.height + CONTENT_TILE_SIZE - 1) / CONTENT_TILE_SIZE;
+	visual.bins = (size_t)visual.columns * visual.rows * VISUAL_TILE_BINS;
+	visual.root = DefaultRootWindow(dpy);
+
+	g_free(visual.storage);
+	visual.storage = g_malloc(visual.bins * (VISUAL_RING_SIZE + 1) * sizeof(uint16_t));
+	int i;
+	for (i = 0; i < VISUAL_RING_SIZE; i++) {
+		visual.ring[i].histograms = visual.storage + visual.bins * i;
+	}
+	visual.initial.histograms = visual.storage + visual.bins * VISUAL_RING_SIZE;
+	rc = true;
+
+out:
+	g_strfreev(fields);
+	return rc;
+}
+
+
+void visual_fini()
+{
+	g_free(visual.storage);
+	visual.storage = NULL;
+	visual.active = false;
+}
+
+
+void visual_start(const struct timeval* action)
+{
+	if (!visual.storage) return;
+
+	visual.action = *action;
+	visual.head = 0;
+	visual.count = 0;
+	visual.dropped = 0;
+	visual.active = visual_sample(&visual.initial, action);
+}
+
+
+void visual_register_damage(int x, int y, int width, int height)
+{
+	if (!visual.active) return;
+
+	Rectangle* rect = &visual.rect;
+	if (x >= rect->x + rect->width || x + width <= rect->x || y >= rect->y + rect->height || y + height <= rect->y) {
+		return;
+	}
+	visual.pending = true;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	visual_update(&now);
+}
+
+
+void visual_update(const struct timeval* now)
+{
+	if (visual.active && visual.pending && timeval_diff_ms(now, &visual.last_sample) >= visual.interval) {
+		visual_sample_next(now);
+	}
+}
+
+
+void visual_finish()
+{
+	if (!visual.active) return;
+	visual.active = false;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	visual_sample_next(&now);
+	if (!visual.count) return;
+
+	const visual_frame_t* final = &visual.ring[(visual.head + VISUAL_RING_SIZE - 1) % VISUAL_RING_SIZE];
+	unsigned long long total = visual_distance(&visual.initial, final);
+	if (!total) {
+		report_add_message_forced("\t%32s no visual change\n", "(visual)");
+		return;
+	}
+
+	/* Walk the frames from the newest to the oldest, tracking the earliest time since which
+	 * the completeness stays above every threshold and the area above the completeness curve. */
+	static const int thresholds[] = {85, 95, 100};
+	int complete[G_N_ELEMENTS(thresholds)];
+	bool reached[G_N_ELEMENTS(thresholds)];
+	double speed_index = 0;
+	int next_time = final->time;
+	unsigned int i, n;
+	for (n = 0; n < G_N_ELEMENTS(thresholds); n++) {
+		reached[n] = true;
+		complete[n] = final->time;
+	}
+	for (i = 0; i < visual.count; i++) {
+		const visual_frame_t* frame = &visual.ring[(visual.head + VISUAL_RING_SIZE - 1 - i) % VISUAL_RING_SIZE];
+		unsigned long long distance = visual_distance(frame, final);
+		double completeness = distance >= total ? 0 : 1 - (double)distance / total;
+
+		speed_index += (1 - completeness) * (next_time - frame->time);
+		next_time = frame->time;
+		for (n = 0; n < G_N_ELEMENTS(thresholds); n++) {
+			if (reached[n] && distance * 100 <= total * (100 - thresholds[n])) {
+				complete[n] = frame->time;
+			}
+			else {
+				reached[n] = false;
+			}
+		}
+	}
+	/* the initial frame is by definition 0% complete */
+	speed_index += next_time;
+
+	report_add_message_forced("\t%32s speed index %.0f, complete 85%% %ims, 95%% %ims, 100%% %ims "
+			"(%u frames, %u dropped)\n", "(visual)", speed_index, complete[0], complete[1], complete[2],
+			visual.count, visual.dropped);
+}
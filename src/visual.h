@@ -0,0 +1,113 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file visual.h
+ * Visual completeness and speed index measurement.
+ *
+ * visual.c|h files sample the content of a screen region after user action.
+ * The region is fetched when damage arrives, at most at the specified frame
+ * rate, and reduced to per tile color histograms stored in a preallocated
+ * frame ring. When the response checking ends, the visual completeness of
+ * every sampled frame is calculated against the final frame, giving the
+ * speed index (the area above the visual completeness curve) and the times
+ * the region became 85%, 95% and 100% complete.
+ */
+
+#ifndef _VISUAL_H_
+#define _VISUAL_H_
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include <X11/Xlib.h>
+
+/* the maximum number of sampled frames per user action */
+#define VISUAL_RING_SIZE		64
+
+/* the default sampling rate (frames per second) */
+#define VISUAL_DEFAULT_FPS		10
+
+/**
+ * Initializes the visual completeness measurement.
+ *
+ * @param[in] dpy    the connected display.
+ * @param[in] text   the measurement parameters - fps[,REGION], where REGION
+ *                   is either WxH+X+Y or the name of a monitored area. The
+ *                   whole screen is sampled by default.
+ * @return           true if the measurement was initialized.
+ */
+bool visual_init(Display* dpy, const char* text);
+
+
+/**
+ * Releases resources allocated by the visual completeness measurement.
+ */
+void visual_fini();
+
+
+/**
+ * Starts sampling frames after user action.
+ *
+ * The current region content is sampled as the initial frame.
+ * @param[in] action   the local time of the user action.
+ */
+void visual_start(const struct timeval* action);
+
+
+/**
+ * Registers damage, sampling the region if the frame interval has elapsed.
+ *
+ * @param[in] x        the damage left coordinate in screen.
+ * @param[in] y        the damage top coordinate in screen.
+ * @param[in] width    the damage width.
+ * @param[in] height   the damage height.
+ */
+void visual_register_damage(int x, int y, int width, int height);
+
+
+/**
+ * Samples the region if it was damaged after the last sampled frame and
+ * the frame interval has elapsed.
+ *
+ * Must be called periodically during response checking.
+ * @param[in] now   the current local time.
+ */
+void visual_update(const struct timeval* now);
+
+
+/**
+ * Samples the final frame and reports the visual completeness of the
+ * user action.
+ */
+void visual_finish();
+
+#endif
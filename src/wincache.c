@@ -0,0 +1,468 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include <X11/Xatom.h>
+#include <X11/Xutil.h>
+
+#include "wincache.h"
+#include "xhandler.h"
+
+/* cached property flags */
+enum {
+	CACHE_RESOURCE = 1 << 0,
+	CACHE_WM_STATE = 1 << 1,
+	CACHE_ATTRIBUTES = 1 << 2,
+	CACHE_CLIENT = 1 << 3,
+	CACHE_PARENT = 1 << 4,
+};
+
+/**
+ * Cached window properties.
+ */
+typedef struct {
+	/* the window id */
+	Window window;
+	/* the valid properties (CACHE_* flags) */
+	unsigned int valid;
+	/* the resource name (NULL if the window has no WM_CLASS) */
+	char* resource;
+	/* true if the window has WM_STATE property */
+	bool wm_state;
+	/* true if the window is an InputOutput window */
+	bool input_output;
+	/* true if the window is viewable */
+	bool viewable;
+	/* the client window of this (frame) window */
+	Window client;
+	/* the frame window which client mapping depends on this window */
+	Window frame;
+	/* the parent window */
+	Window parent;
+	/* the properties requested asynchronously (CACHE_WM_STATE, CACHE_ATTRIBUTES flags) */
+	unsigned int requested;
+	/* the WM_STATE property request */
+	xcb_get_property_cookie_t wm_state_cookie;
+	/* the window attributes request */
+	xcb_get_window_attributes_cookie_t attributes_cookie;
+} entry_t;
+
+
+/**
+ * Window property cache data.
+ */
+typedef struct {
+	/* the connected display */
+	Display* display;
+	/* the cached windows, indexed by window id */
+	GHashTable* entries;
+	/* WM_STATE atom */
+	Atom wm_state_atom;
+} wincache_t;
+
+/**
+ * Window tree mirror node, used for sorting windows by depth.
+ */
+typedef struct {
+	/* the window */
+	Window window;
+	/* the number of ancestors below root window */
+	unsigned int depth;
+} tree_node_t;
+
+static wincache_t wincache = {
+		.display = NULL,
+		.entries = NULL,
+		.wm_state_atom = None,
+};
+
+
+static void entry_free(entry_t* entry)
+{
+	if (entry->requested & CACHE_WM_STATE) {
+		xcb_discard_reply(xhandler.connection, entry->wm_state_cookie.sequence);
+	}
+	if (entry->requested & CACHE_ATTRIBUTES) {
+		xcb_discard_reply(xhandler.connection, entry->attributes_cookie.sequence);
+	}
+	g_free(entry->resource);
+	g_slice_free(entry_t, entry);
+}
+
+
+/**
+ * Finds cached window entry.
+ */
+static entry_t* entry_find(Window window)
+{
+	return g_hash_table_lookup(wincache.entries, (gconstpointer)window);
+}
+
+
+/**
+ * Finds cached window entry or creates a new one.
+ *
+ * The property change events are selected for new entries to keep the
+ * cached data up to date.
+ */
+static entry_t* entry_get(Window window)
+{
+	entry_t* entry = entry_find(window);
+	if (!entry) {
+		entry = g_slice_new0(entry_t);
+		entry->window = window;
+		g_hash_table_insert(wincache.entries, (gpointer)window, entry);
+		if (window != DefaultRootWindow(wincache.display)) {
+			XSelectInput(wincache.display, window, WINCACHE_EVENT_MASK);
+		}
+	}
+	return entry;
+}
+
+
+/**
+ * Requests window properties asynchronously.
+ *
+ * The replies are read when the properties are accessed, so the client
+ * window search doesn't wait for server round trips. A pending request is
+ * replaced, as its reply could be outdated.
+ * @param[in] entry   the window entry.
+ * @param[in] flags   the properties to request (CACHE_WM_STATE, CACHE_ATTRIBUTES flags).
+ */
+static void entry_request(entry_t* entry, unsigned int flags)
+{
+	if (flags & CACHE_WM_STATE) {
+		if (entry->requested & CACHE_WM_STATE) {
+			xcb_discard_reply(xhandler.connection, entry->wm_state_cookie.sequence);
+		}
+		entry->wm_state_cookie = xcb_get_property(xhandler.connection, 0, entry->window, wincache.wm_state_atom,
+				XCB_GET_PROPERTY_TYPE_ANY, 0, 0);
+	}
+	if (flags & CACHE_ATTRIBUTES) {
+		if (entry->requested & CACHE_ATTRIBUTES) {
+			xcb_discard_reply(xhandler.connection, entry->attributes_cookie.sequence);
+		}
+		entry->attributes_cookie = xcb_get_window_attributes(xhandler.connection, entry->window);
+	}
+	entry->requested |= flags;
+	entry->valid &= ~flags;
+}
+
+
+/**
+ * Compares window tree mirror nodes by their depth.
+ */
+static gint compare_tree_nodes(const tree_node_t* node1, const tree_node_t* node2)
+{
+	return (gint)node1->depth - (gint)node2->depth;
+}
+
+
+/**
+ * Invalidates client mapping of the frame window depending on the entry.
+ */
+static void entry_invalidate_frame(entry_t* entry)
+{
+	if (entry->frame) {
+		entry_t* frame = entry_find(entry->frame);
+		if (frame) frame->valid &= ~CACHE_CLIENT;
+		entry->frame = None;
+	}
+}
+
+
+static bool entry_has_wm_state(entry_t* entry)
+{
+	if (!(entry->valid & CACHE_WM_STATE)) {
+		if (!(entry->requested & CACHE_WM_STATE)) entry_request(entry, CACHE_WM_STATE);
+
+		xcb_get_property_reply_t* reply = xcb_get_property_reply(xhandler.connection, entry->wm_state_cookie, NULL);
+		entry->requested &= ~CACHE_WM_STATE;
+		entry->wm_state = reply && reply->type != None;
+		entry->valid |= CACHE_WM_STATE;
+		free(reply);
+	}
+	return entry->wm_state;
+}
+
+
+static bool entry_is_viewable(entry_t* entry)
+{
+	if (!(entry->valid & CACHE_ATTRIBUTES)) {
+		if (!(entry->requested & CACHE_ATTRIBUTES)) entry_request(entry, CACHE_ATTRIBUTES);
+
+		xcb_get_window_attributes_reply_t* reply = xcb_get_window_attributes_reply(xhandler.connection,
+				entry->attributes_cookie, NULL);
+		entry->requested &= ~CACHE_ATTRIBUTES;
+		if (!reply) return false;
+		entry->input_output = reply->_class == XCB_WINDOW_CLASS_INPUT_OUTPUT;
+		entry->viewable = reply->map_state == XCB_MAP_STATE_VIEWABLE;
+		entry->valid |= CACHE_ATTRIBUTES;
+		free(reply);
+	}
+	return entry->input_output && entry->viewable;
+}
+
+
+/**
+ * Searches the mirrored window subtree for client window.
+ *
+ * @param[in] window   the window to search.
+ * @param[in] frame    the top level window the search was started from.
+ * @return             the client window or None.
+ */
+static Window find_client(Window window, Window frame)
+{
+	GPtrArray* children = g_ptr_array_new();
+	GHashTableIter iter;
+	entry_t* entry;
+	Window win = None;
+	guint i;
+
+	g_hash_table_iter_init(&iter, wincache.entries);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&entry)) {
+		if ((entry->valid & CACHE_PARENT) && entry->parent == window) g_ptr_array_add(children, entry);
+	}
+
+	/* Check each child for WM_STATE and other validity */
+	for (i = 0; i < children->len; i++) {
+		entry = g_ptr_array_index(children, i);
+		/* changes of the child properties affect the frame client mapping */
+		entry->frame = frame;
+		if (!entry_is_viewable(entry)) {
+			g_ptr_array_index(children, i) = NULL; /* Don't bother descending into this one */
+			continue;
+		}
+		if (entry_has_wm_state(entry)) {
+			/* Got one */
+			win = entry->window;
+			break;
+		}
+	}
+
+	/* No children matched, now descend into each child */
+	for (i = 0; win == None && i < children->len; i++) {
+		entry = g_ptr_array_index(children, i);
+		if (entry) win = find_client(entry->window, frame);
+	}
+	g_ptr_array_free(children, TRUE);
+
+	return win;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+void wincache_init(Display* display)
+{
+	wincache.display = display;
+	wincache.wm_state_atom = XInternAtom(display, "WM_STATE", False);
+	wincache.entries = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)entry_free);
+}
+
+
+void wincache_fini()
+{
+	if (wincache.entries) {
+		g_hash_table_destroy(wincache.entries);
+		wincache.entries = NULL;
+	}
+}
+
+
+const char* wincache_get_resource_name(Window window)
+{
+	entry_t* entry = entry_get(window);
+	if (!(entry->valid & CACHE_RESOURCE)) {
+		XClassHint classhint;
+
+		g_free(entry->resource);
+		entry->resource = NULL;
+		if (XGetClassHint(wincache.display, window, &classhint)) {
+			entry->resource = g_strdup(classhint.res_name);
+			XFree(classhint.res_name);
+			XFree(classhint.res_class);
+		}
+		entry->valid |= CACHE_RESOURCE;
+	}
+	return entry->resource;
+}
+
+
+void wincache_set_resource_name(Window window, const char* resource)
+{
+	entry_t* entry = entry_get(window);
+	g_free(entry->resource);
+	entry->resource = g_strdup(resource);
+	entry->valid |= CACHE_RESOURCE;
+}
+
+
+Window wincache_find_client(Window window)
+{
+	if (window == None) return None;
+
+	entry_t* entry = entry_get(window);
+	if (!(entry->valid & CACHE_CLIENT)) {
+		/* the window itself is the client if it has WM_STATE property */
+		entry->client = entry_has_wm_state(entry) ? window : find_client(window, window);
+		entry->valid |= CACHE_CLIENT;
+	}
+	return entry->client;
+}
+
+
+void wincache_add_window(Window window, Window parent)
+{
+	entry_t* entry = entry_get(window);
+	entry->parent = parent;
+	entry->valid |= CACHE_PARENT;
+	/* prefetch the properties needed to find client windows at user input */
+	entry_request(entry, ~entry->valid & (CACHE_WM_STATE | CACHE_ATTRIBUTES));
+}
+
+
+Window wincache_get_parent(Window window)
+{
+	if (window == DefaultRootWindow(wincache.display)) return None;
+
+	/* the windows are mirrored from the tree scan and Create/Reparent notifications,
+	 * so the server is not queried for the unknown parents */
+	entry_t* entry = entry_find(window);
+	return entry && (entry->valid & CACHE_PARENT) ? entry->parent : None;
+}
+
+
+bool wincache_has_window(Window window)
+{
+	return window == DefaultRootWindow(wincache.display) || entry_find(window) != NULL;
+}
+
+
+GArray* wincache_get_windows()
+{
+	Window root = DefaultRootWindow(wincache.display);
+	GArray* nodes = g_array_new(FALSE, FALSE, sizeof(tree_node_t));
+	GHashTableIter iter;
+	entry_t* entry;
+	unsigned int i;
+
+	g_hash_table_iter_init(&iter, wincache.entries);
+	while (g_hash_table_iter_next(&iter, NULL, (gpointer*)&entry)) {
+		if (!(entry->valid & CACHE_PARENT)) continue;
+
+		tree_node_t node = { .window = entry->window, .depth = 0 };
+		entry_t* ancestor = entry;
+		while (ancestor && ancestor->parent != root) {
+			ancestor = entry_find(ancestor->parent);
+			if (ancestor && !(ancestor->valid & CACHE_PARENT)) ancestor = NULL;
+			node.depth++;
+		}
+		if (ancestor) g_array_append_val(nodes, node);
+	}
+	g_array_sort(nodes, (GCompareFunc)compare_tree_nodes);
+
+	GArray* windows = g_array_sized_new(FALSE, FALSE, sizeof(Window), nodes->len);
+	for (i = 0; i < nodes->len; i++) {
+		g_array_append_val(windows, g_array_index(nodes, tree_node_t, i).window);
+	}
+	g_array_free(nodes, TRUE);
+	return windows;
+}
+
+
+void wincache_process_event(XEvent* ev)
+{
+	entry_t* entry;
+
+	switch (ev->type) {
+	case CreateNotify:
+		/* mirror the new window, its children are tracked from now on */
+		wincache_add_window(ev->xcreatewindow.window, ev->xcreatewindow.parent);
+		xcb_flush(xhandler.connection);
+		break;
+
+	case PropertyNotify:
+		if (!(entry = entry_find(ev->xproperty.window))) break;
+
+		if (ev->xproperty.atom == XA_WM_CLASS) {
+			entry->valid &= ~CACHE_RESOURCE;
+		}
+		else if (ev->xproperty.atom == wincache.wm_state_atom) {
+			entry->wm_state = ev->xproperty.state == PropertyNewValue;
+			entry->valid = (entry->valid | CACHE_WM_STATE) & ~CACHE_CLIENT;
+			entry_invalidate_frame(entry);
+		}
+		break;
+
+	case MapNotify:
+	case UnmapNotify:
+		if (!(entry = entry_find(ev->type == MapNotify ? ev->xmap.window : ev->xunmap.window))) break;
+
+		entry->viewable = ev->type == MapNotify;
+		entry->valid &= ~CACHE_CLIENT;
+		/* the pending reply can contain the previous map state */
+		if (entry->requested & CACHE_ATTRIBUTES) {
+			entry_request(entry, CACHE_ATTRIBUTES);
+			xcb_flush(xhandler.connection);
+		}
+		entry_invalidate_frame(entry);
+		break;
+
+	case ReparentNotify:
+		if ((entry = entry_find(ev->xreparent.parent))) {
+			entry->valid &= ~CACHE_CLIENT;
+			entry_invalidate_frame(entry);
+		}
+		if ((entry = entry_find(ev->xreparent.window))) {
+			entry->valid &= ~(CACHE_CLIENT | CACHE_ATTRIBUTES);
+			entry_invalidate_frame(entry);
+		}
+		wincache_add_window(ev->xreparent.window, ev->xreparent.parent);
+		xcb_flush(xhandler.connection);
+		break;
+
+	case DestroyNotify:
+		if ((entry = entry_find(ev->xdestroywindow.window))) {
+			entry_invalidate_frame(entry);
+			g_hash_table_remove(wincache.entries, (gconstpointer)ev->xdestroywindow.window);
+		}
+		break;
+	}
+}
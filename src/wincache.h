@@ -0,0 +1,156 @@
+/*
+ * xresponse - Interaction latency tester,
+ *
+ * Written by Ross Burton & Matthew Allum
+ *              <info@openedhand.com>
+ *
+ * Copyright (C) 2005,2011 Nokia
+ *
+ * Licensed under the GPL v2 or greater.
+ *
+ * Window detection is based on code that is Copyright (C) 2007 Kim Woelders.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+/**
+ * @file wincache.h
+ * Window property cache.
+ *
+ * wincache.c|h files cache window properties needed for window admission
+ * and user input attribution - resource name, WM_STATE presence, viewable
+ * state and frame to client window mapping. The properties are requested
+ * from server only on the first access and then kept up to date from
+ * Map/Unmap/Reparent/Destroy/PropertyNotify events, so in steady state
+ * the lookups don't need server round trips.
+ *
+ * The cache also mirrors the window tree. Substructure notifications are
+ * selected for every cached window, so the parent links are maintained
+ * from Create/Reparent/Destroy events and new windows are added to the
+ * mirror as they are created. The notifications of a window are received
+ * from its parent only, structure notifications are not selected for the
+ * window itself, so they are not received twice.
+ */
+
+#ifndef _WINCACHE_H_
+#define _WINCACHE_H_
+
+#include <stdbool.h>
+
+#include <glib.h>
+
+#include <X11/Xlib.h>
+
+/* the event mask selected for cached (and monitored) windows */
+#define WINCACHE_EVENT_MASK	(SubstructureNotifyMask | PropertyChangeMask)
+
+/**
+ * Initializes window property cache.
+ *
+ * @param[in] display   the connected display.
+ */
+void wincache_init(Display* display);
+
+
+/**
+ * Releases resources allocated by window property cache.
+ */
+void wincache_fini();
+
+
+/**
+ * Retrieves window resource name (WM_CLASS res_name).
+ *
+ * @param[in] window   the window.
+ * @return             the resource name or NULL if the window has no
+ *                     WM_CLASS property. The returned string is valid until
+ *                     the next window property change event is processed.
+ */
+const char* wincache_get_resource_name(Window window);
+
+
+/**
+ * Stores window resource name received by other means.
+ *
+ * @param[in] window     the window.
+ * @param[in] resource   the resource name.
+ */
+void wincache_set_resource_name(Window window, const char* resource);
+
+
+/**
+ * Finds client window (a viewable window with WM_STATE property) of the
+ * specified window.
+ *
+ * The client window is searched in the window tree mirror.
+ * @param[in] window   the top level (frame) window.
+ * @return             the client window or None if not found.
+ */
+Window wincache_find_client(Window window);
+
+
+/**
+ * Adds window to the window tree mirror.
+ *
+ * Used to register windows found by querying window tree.
+ * @param[in] window   the window.
+ * @param[in] parent   the parent window.
+ */
+void wincache_add_window(Window window, Window parent);
+
+
+/**
+ * Retrieves parent of the specified window from the window tree mirror.
+ *
+ * @param[in] window   the window.
+ * @return             the parent window or None for root window (or if the
+ *                     window is not mirrored).
+ */
+Window wincache_get_parent(Window window);
+
+
+/**
+ * Checks if the window is cached.
+ *
+ * The substructure notifications are selected for all cached windows.
+ * @param[in] window   the window.
+ * @return             true if the window is cached or is the root window.
+ */
+bool wincache_has_window(Window window);
+
+
+/**
+ * Retrieves the windows of the window tree mirror.
+ *
+ * The windows are sorted by their depth in the window tree, so parents
+ * precede their children. Windows which ancestors are not mirrored are
+ * skipped.
+ * @return   the window ids (Window). Must be released with g_array_free().
+ */
+GArray* wincache_get_windows();
+
+
+/**
+ * Updates the cache from X event.
+ *
+ * @param[in] ev   the event.
+ */
+void wincache_process_event(XEvent* ev);
+
+#endif
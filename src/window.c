@@ -36,11 +36,53 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 
 #include <glib.h>
 
+#include <X11/Xatom.h>
+#include <xcb/xcbext.h>
+
 #include "xresponse.h"
 #include "application.h"
+#include "xhandler.h"
+#include "report.h"
+#include "wincache.h"
+#include "present.h"
+
+/**
+ * Window waiting for admission.
+ */
+typedef struct {
+	/* the window id */
+	Window window;
+	/* the damage context, created when the window is mapped */
+	Damage damage;
+	/* the time the window was queued or last requeued */
+	struct timeval queued;
+	/* the WM_CLASS property request */
+	xcb_get_property_cookie_t cookie;
+	/* true if the WM_CLASS property request is in progress */
+	bool requested;
+	/* the buffered damage events (XDamageNotifyEvent) */
+	GQueue events;
+} pending_t;
+
+
+/**
+ * Window tree scan node.
+ */
+typedef struct {
+	/* the window id */
+	Window window;
+	/* the parent window id */
+	Window parent;
+	/* the children request */
+	xcb_query_tree_cookie_t tree;
+	/* the WM_CLASS property request (not sent for the scan root) */
+	xcb_get_property_cookie_t property;
+} scan_node_t;
+
 
 /**
  * Windows monitor data structure.
@@ -49,17 +91,38 @@ typedef struct {
 	/* window list */
 	GList* windows;
 
+	/* monitored windows, indexed by window id */
+	GHashTable* index;
+
+	/* windows waiting for admission (pending_t), in request order */
+	GQueue pending;
+	/* the admission queue links, indexed by window id */
+	GHashTable* pending_index;
+
 	/* the connected display */
 	Display* display;
 
 	/* damage reporting level */
 	int damage_level;
+
+	/* the root window damage context in root damage mode */
+	Damage root_damage;
+
+	/* the current level of window tree scan (scan_node_t) */
+	GArray* scan;
+	/* the window tree scan start time */
+	struct timeval scan_start;
 } monitor_t;
 
 static monitor_t monitor = {
 		.windows = NULL,
+		.index = NULL,
+		.pending = G_QUEUE_INIT,
+		.pending_index = NULL,
 		.display = NULL,
 		.damage_level = XDamageReportBoundingBox,
+		.root_damage = None,
+		.scan = NULL,
 };
 
 
@@ -70,56 +133,280 @@ static monitor_t monitor = {
 static void window_free(window_t* win, void* __attribute__((unused)) data)
 {
 	if (win->damage) XDamageDestroy(monitor.display, win->damage);
+	present_deselect_window(win->window, win->present);
 	if (win->application) application_release(win->application);
 	g_slice_free(window_t, win);
 }
 
 
+
 /**
- * Compares window id with the specified id.
- * @param[in] win     the window to check.
- * @param[in] window  the id to compare.
- * @return            0 if id's match.
+ * Destroys the damage context of the window.
+ *
+ * The damage context is created again with the current damage reporting
+ * level when the window monitoring is started.
+ * @param[in] win  the window.
  */
-static gint compare_window(window_t* win, Window window)
+static void window_release_damage(window_t* win, void* __attribute__((unused)) data)
 {
-	return win->window == window ? 0 : 1;
+	if (win->damage) {
+		XDamageDestroy(monitor.display, win->damage);
+		win->damage = 0;
+	}
 }
 
+
+/**
+ * Clears the measurement data of the window at the end of a session.
+ *
+ * @param[in] win  the window.
+ */
+static void window_reset_state(window_t* win, void* __attribute__((unused)) data)
+{
+	present_deselect_window(win->window, win->present);
+	win->present = 0;
+	win->rate_start = 0;
+	win->rate_count = 0;
+	win->rate = 0;
+}
+
+
 /**
  * Start monitoring the specified window.
  *
+ * The damage context of a window kept from the previous session is reused.
  * @param[in] win  the window to monitor.
  * @return         true if the window monitoring started successfully.
  */
 static bool window_start_monitor(window_t* win)
 {
-	win->damage = XDamageCreate(monitor.display, win->window, monitor.damage_level);
-	if (!win->damage) {
+	/* in root damage mode the window damage is attributed from the root window damage */
+	if (!monitor.root_damage && !win->damage) {
+		win->damage = XDamageCreate(monitor.display, win->window, monitor.damage_level);
+	}
+	if (!monitor.root_damage && !win->damage) {
 		fprintf(stderr, "XDamageCreate failed for window %lx, application %s\n", win->window,
 				win->application ? win->application->name : "(null)");
 		return false;
 	}
 	if (win->window != DefaultRootWindow(monitor.display)) {
-		XSelectInput(monitor.display, win->window, StructureNotifyMask);
+		XSelectInput(monitor.display, win->window, WINCACHE_EVENT_MASK);
 	}
+	if (!win->present) win->present = present_select_window(win->window);
 	return true;
 }
 
 
 /**
  * Attempts to monitor the specified window and removes it from
- * the list if failed.
+ * the list if failed or if its application is no longer monitored.
  * @param[in] win   the window to monitor.
  */
 static void window_monitor_or_remove(window_t* win, void* __attribute__((unused)) data)
 {
-	if (!window_start_monitor(win)) {
+	if (!application_is_monitored(win->application) || !window_start_monitor(win)) {
 		window_remove(win);
 	}
 }
 
 
+/**
+ * Sends asynchronous WM_CLASS property request.
+ *
+ * @param[in] window   the window.
+ * @return             the request cookie.
+ */
+static xcb_get_property_cookie_t request_resource_name(Window window)
+{
+	return xcb_get_property(xhandler.connection, 0, window, XA_WM_CLASS, XA_STRING, 0, PATH_MAX / 4);
+}
+
+
+/**
+ * Retrieves resource name from WM_CLASS property reply.
+ *
+ * @param[in] reply      the property reply.
+ * @param[out] resource  the resource name buffer of PATH_MAX size.
+ * @return               true if the property was set.
+ */
+static bool reply_get_resource_name(xcb_get_property_reply_t* reply, char* resource)
+{
+	int length = xcb_get_property_value_length(reply);
+	if (length <= 0) return false;
+
+	if (length >= PATH_MAX) length = PATH_MAX - 1;
+	/* WM_CLASS contains null terminated res_name and res_class strings */
+	memcpy(resource, xcb_get_property_value(reply), length);
+	resource[length] = '\0';
+	return true;
+}
+
+
+/**
+ * Adds scan node to the scan level and sends its requests.
+ *
+ * @param[in] level    the scan level.
+ * @param[in] window   the window to scan.
+ * @param[in] parent   the parent window (None for the scan root).
+ */
+static void scan_request(GArray* level, Window window, Window parent)
+{
+	scan_node_t node = {
+			.window = window,
+			.parent = parent,
+			.tree = xcb_query_tree(xhandler.connection, window),
+	};
+	if (parent != None) node.property = request_resource_name(window);
+	g_array_append_val(level, node);
+}
+
+
+/**
+ * Tries to monitor the windows mirrored by the window cache.
+ *
+ * Used instead of the window tree scan when the mirror was populated by an
+ * earlier scan, for example by the daemon before its measurement sessions.
+ */
+static void scan_cache()
+{
+	struct timeval start, end;
+	unsigned int i;
+
+	gettimeofday(&start, NULL);
+	GArray* windows = wincache_get_windows();
+	for (i = 0; i < windows->len; i++) {
+		Window window = g_array_index(windows, Window, i);
+		/* children of monitored windows are not monitored separately */
+		if (!window_find_ancestor(wincache_get_parent(window))) {
+			window_try_monitor(window);
+		}
+	}
+	gettimeofday(&end, NULL);
+	report_add_message(REPORT_LAST_TIMESTAMP, "Scanned %u cached windows (%.1f ms)\n", windows->len,
+			(end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_usec - start.tv_usec) / 1000.0);
+	g_array_free(windows, TRUE);
+}
+
+
+/**
+ * Sends asynchronous WM_CLASS property request for the queued window.
+ *
+ * @param[in] pending   the queued window.
+ */
+static void pending_request(pending_t* pending)
+{
+	pending->cookie = request_resource_name(pending->window);
+	pending->requested = true;
+	xcb_flush(xhandler.connection);
+}
+
+
+/**
+ * Starts damage monitoring of the queued window.
+ *
+ * @param[in] pending   the queued window.
+ */
+static void pending_monitor_damage(pending_t* pending)
+{
+	/* in root damage mode the window damage is attributed from the root window damage */
+	if (!monitor.root_damage && !pending->damage) {
+		pending->damage = XDamageCreate(monitor.display, pending->window, monitor.damage_level);
+		XFlush(monitor.display);
+	}
+}
+
+
+/**
+ * Releases resources allocated by queued window.
+ *
+ * @param[in] pending   the queued window.
+ */
+static void pending_free(pending_t* pending)
+{
+	XDamageNotifyEvent* dev;
+	while ((dev = g_queue_pop_head(&pending->events))) {
+		g_slice_free(XDamageNotifyEvent, dev);
+	}
+	if (pending->requested) {
+		xcb_discard_reply(xhandler.connection, pending->cookie.sequence);
+	}
+	g_slice_free(pending_t, pending);
+}
+
+
+/**
+ * Searches admission queue for the specified window.
+ */
+static GList* pending_find(Window window)
+{
+	return monitor.pending_index ? g_hash_table_lookup(monitor.pending_index, (gconstpointer)window) : NULL;
+}
+
+
+/**
+ * Removes the window from admission queue.
+ *
+ * @param[in] node   the admission queue link of the window.
+ * @return           the removed window.
+ */
+static pending_t* pending_remove(GList* node)
+{
+	pending_t* pending = node->data;
+	g_hash_table_remove(monitor.pending_index, (gconstpointer)pending->window);
+	g_queue_delete_link(&monitor.pending, node);
+	return pending;
+}
+
+
+/**
+ * Drops all windows waiting for admission.
+ */
+static void pending_clear()
+{
+	pending_t* pending;
+	while ((pending = g_queue_pop_head(&monitor.pending))) {
+		if (pending->damage) XDamageDestroy(monitor.display, pending->damage);
+		pending_free(pending);
+	}
+	if (monitor.pending_index) g_hash_table_remove_all(monitor.pending_index);
+}
+
+
+/**
+ * Admits or drops the queued window after receiving its resource name.
+ *
+ * @param[in] pending    the queued window.
+ * @param[in] resource   the resource name.
+ * @param[in] handler    the damage event handler for buffered events.
+ */
+static void pending_admit(pending_t* pending, const char* resource, window_damage_handler_t handler)
+{
+	/* damage of the window is already reported by its monitored ancestor */
+	if (window_find_ancestor(pending->window)) {
+		if (pending->damage) XDamageDestroy(monitor.display, pending->damage);
+		return;
+	}
+	application_t* app = application_try_monitor(resource);
+	if (!app) {
+		if (pending->damage) XDamageDestroy(monitor.display, pending->damage);
+		return;
+	}
+	wincache_set_resource_name(pending->window, resource);
+	/* the window can be mapped after the admission */
+	pending_monitor_damage(pending);
+	window_t* win = window_add(pending->window, app);
+	win->damage = pending->damage;
+	win->present = present_select_window(win->window);
+	report_add_message(REPORT_LAST_TIMESTAMP, "Created window 0x%lx (%s)\n", win->window, app->name);
+
+	XDamageNotifyEvent* dev;
+	while ((dev = g_queue_pop_head(&pending->events))) {
+		handler(dev);
+		g_slice_free(XDamageNotifyEvent, dev);
+	}
+}
+
+
 /*
  * Public API implementation.
  */
@@ -127,54 +414,106 @@ static void window_monitor_or_remove(window_t* win, void* __attribute__((unused)
 void window_init(Display* display)
 {
 	monitor.windows = NULL;
+	g_queue_init(&monitor.pending);
+	monitor.pending_index = g_hash_table_new(g_direct_hash, g_direct_equal);
+	monitor.index = g_hash_table_new(g_direct_hash, g_direct_equal);
 	monitor.display = display;
+	monitor.damage_level = XDamageReportBoundingBox;
 }
 
 
 void window_fini()
 {
+	pending_clear();
+	if (monitor.pending_index) {
+		g_hash_table_destroy(monitor.pending_index);
+		monitor.pending_index = NULL;
+	}
 	g_list_foreach(monitor.windows, (GFunc)window_free, NULL);
 	g_list_free(monitor.windows);
+	monitor.windows = NULL;
+	if (monitor.index) {
+		g_hash_table_destroy(monitor.index);
+		monitor.index = NULL;
+	}
+	if (monitor.root_damage) {
+		XDamageDestroy(monitor.display, monitor.root_damage);
+		monitor.root_damage = None;
+	}
+}
+
+
+void window_reset()
+{
+	/* the pending windows are admitted by the applications of the session */
+	pending_clear();
+
+	g_list_foreach(monitor.windows, (GFunc)window_reset_state, NULL);
+	window_set_damage_level(XDamageReportBoundingBox);
+	if (monitor.root_damage) {
+		XDamageDestroy(monitor.display, monitor.root_damage);
+		monitor.root_damage = None;
+	}
 }
 
 
 void window_remove(window_t* win)
 {
 	monitor.windows = g_list_remove(monitor.windows, win);
+	g_hash_table_remove(monitor.index, (gconstpointer)win->window);
 	window_free(win, NULL);
 }
 
 void window_set_damage_level(int level)
 {
+	/* the windows kept from the previous session report damage at its level */
+	if (level != monitor.damage_level) {
+		g_list_foreach(monitor.windows, (GFunc)window_release_damage, NULL);
+	}
 	monitor.damage_level = level;
 }
 
 
+bool window_monitor_root_damage()
+{
+	g_list_foreach(monitor.windows, (GFunc)window_release_damage, NULL);
+	monitor.root_damage = XDamageCreate(monitor.display, DefaultRootWindow(monitor.display), monitor.damage_level);
+	return monitor.root_damage != None;
+}
+
+
+bool window_is_root_damage(Damage damage)
+{
+	return monitor.root_damage && damage == monitor.root_damage;
+}
+
+
 window_t* window_find(Window window)
 {
-	GList* node = g_list_find_custom(monitor.windows, (gconstpointer)window, (GCompareFunc)compare_window);
-	return node ? node->data : NULL;
+	return g_hash_table_lookup(monitor.index, (gconstpointer)window);
 }
 
 
-const char* window_get_resource_name(Window window)
+window_t* window_find_ancestor(Window window)
 {
-	static char resource_name[PATH_MAX];
-	XClassHint classhint;
+	Window root = DefaultRootWindow(monitor.display);
 
+	while (window != None && window != root) {
+		window_t* win = window_find(window);
+		if (win) return win;
+		window = wincache_get_parent(window);
+	}
+	return NULL;
+}
+
+
+const char* window_get_resource_name(Window window)
+{
 	/* alias the root window to '*' resource */
 	if (window == DefaultRootWindow(monitor.display)) {
-		strcpy(resource_name, ROOT_WINDOW_RESOURCE);
-		return resource_name;
-	}
-	if (XGetClassHint(monitor.display, window, &classhint)) {
-		strncpy(resource_name, classhint.res_name, PATH_MAX);
-		resource_name[PATH_MAX - 1] = '\0';
-		XFree(classhint.res_name);
-		XFree(classhint.res_class);
-		return resource_name;
+		return ROOT_WINDOW_RESOURCE;
 	}
-	return NULL;
+	return wincache_get_resource_name(window);
 }
 
 
@@ -204,29 +543,70 @@ void window_monitor_all()
 }
 
 
-void window_try_monitor_children(Window window)
+void window_scan_begin(Window window)
 {
-	Window root_win, parent_win;
-	Window *child_list;
-	unsigned int num_children;
-	int iWin;
+	gettimeofday(&monitor.scan_start, NULL);
+	monitor.scan = g_array_new(FALSE, FALSE, sizeof(scan_node_t));
+	scan_request(monitor.scan, window, None);
+	xcb_flush(xhandler.connection);
+}
 
-	if (!XQueryTree(monitor.display, window, &root_win, &parent_win, &child_list, &num_children)) {
-		fprintf(stderr, "Cannot query window tree (%lx)\n", window);
+
+void window_scan_end()
+{
+	unsigned int count = 0, levels = 0, i, j;
+	struct timeval end;
+
+	if (!monitor.scan) {
+		scan_cache();
 		return;
 	}
-	for (iWin = 0; iWin < num_children; iWin++) {
-		if (!window_try_monitor(child_list[iWin])) {
-			window_try_monitor_children(child_list[iWin]);
+
+	while (monitor.scan->len) {
+		GArray* next = g_array_new(FALSE, FALSE, sizeof(scan_node_t));
+
+		for (i = 0; i < monitor.scan->len; i++) {
+			scan_node_t* node = &g_array_index(monitor.scan, scan_node_t, i);
+			bool monitored = false;
+
+			if (node->parent != None) {
+				char resource[PATH_MAX];
+				xcb_get_property_reply_t* property = xcb_get_property_reply(xhandler.connection, node->property, NULL);
+
+				wincache_add_window(node->window, node->parent);
+				wincache_set_resource_name(node->window,
+						property && reply_get_resource_name(property, resource) ? resource : NULL);
+				free(property);
+				monitored = window_try_monitor(node->window) != NULL;
+				count++;
+			}
+
+			/* children of monitored windows are not monitored separately */
+			xcb_query_tree_reply_t* tree = xcb_query_tree_reply(xhandler.connection, node->tree, NULL);
+			if (!tree) {
+				fprintf(stderr, "Cannot query window tree (%lx)\n", node->window);
+				continue;
+			}
+			if (!monitored) {
+				xcb_window_t* children = xcb_query_tree_children(tree);
+				for (j = 0; j < (unsigned int)xcb_query_tree_children_length(tree); j++) {
+					scan_request(next, children[j], node->window);
+				}
+			}
+			free(tree);
 		}
+		/* all requests of the next level are sent before waiting for the first reply */
+		xcb_flush(xhandler.connection);
+		g_array_free(monitor.scan, TRUE);
+		monitor.scan = next;
+		levels++;
 	}
-	if (child_list) XFree(child_list);
-}
-
+	g_array_free(monitor.scan, TRUE);
+	monitor.scan = NULL;
 
-bool window_empty()
-{
-	return monitor.windows == NULL;
+	gettimeofday(&end, NULL);
+	report_add_message(REPORT_LAST_TIMESTAMP, "Scanned %u windows in %u levels (%.1f ms)\n", count, levels,
+			(end.tv_sec - monitor.scan_start.tv_sec) * 1000.0 + (end.tv_usec - monitor.scan_start.tv_usec) / 1000.0);
 }
 
 
@@ -236,11 +616,161 @@ window_t* window_add(Window window, application_t* application)
 	win->window = window;
 	win->damage = 0;
 	win->application = application;
+	win->present = 0;
+	win->rate_start = 0;
+	win->rate_count = 0;
+	win->rate = 0;
 	monitor.windows = g_list_prepend(monitor.windows, win);
+	g_hash_table_insert(monitor.index, (gpointer)window, win);
 	return win;
 }
 
 
+void window_queue(Window window, bool mapped)
+{
+	if (window == DefaultRootWindow(monitor.display) || window_find(window) || pending_find(window)) return;
+
+	pending_t* pending = g_slice_new(pending_t);
+	pending->window = window;
+	pending->damage = None;
+	pending->requested = false;
+	gettimeofday(&pending->queued, NULL);
+	g_queue_init(&pending->events);
+	/* the window is cached, so its notifications are already selected. Unmapped
+	 * windows are not damaged, so their damage monitoring starts when mapped. */
+	if (mapped) pending_monitor_damage(pending);
+	pending_request(pending);
+	g_queue_push_tail(&monitor.pending, pending);
+	g_hash_table_insert(monitor.pending_index, (gpointer)window, monitor.pending.tail);
+}
+
+
+void window_unqueue(Window window)
+{
+	GList* node = pending_find(window);
+	if (node) {
+		/* the window is destroyed, so its damage object is destroyed too */
+		pending_free(pending_remove(node));
+	}
+}
+
+
+bool window_is_queued(Window window)
+{
+	return pending_find(window) != NULL;
+}
+
+
+void window_requeue(Window window, bool mapped)
+{
+	GList* node = pending_find(window);
+	if (!node) return;
+
+	pending_t* pending = node->data;
+	if (mapped) pending_monitor_damage(pending);
+	if (!pending->requested) {
+		/* keep the admission queue in request order */
+		g_queue_unlink(&monitor.pending, node);
+		g_queue_push_tail_link(&monitor.pending, node);
+		gettimeofday(&pending->queued, NULL);
+		pending_request(pending);
+	}
+}
+
+
+bool window_buffer_damage(XDamageNotifyEvent* dev)
+{
+	if (g_queue_is_empty(&monitor.pending)) return false;
+
+	GList* node = pending_find(dev->drawable);
+	if (!node) return false;
+
+	pending_t* pending = node->data;
+	if (g_queue_get_length(&pending->events) < WINDOW_PENDING_DAMAGE_MAX) {
+		XDamageNotifyEvent* copy = g_slice_new(XDamageNotifyEvent);
+		*copy = *dev;
+		g_queue_push_tail(&pending->events, copy);
+	}
+	return true;
+}
+
+
+void window_process_pending(window_damage_handler_t handler)
+{
+	GList* node = monitor.pending.head;
+	struct timeval now = {0};
+	/* the replies arrive in request order, so the later requests are not answered either */
+	bool replied = true;
+
+	while (node) {
+		GList* next = node->next;
+		pending_t* pending = node->data;
+
+		if (pending->requested) {
+			char resource[PATH_MAX];
+			xcb_get_property_reply_t* reply = NULL;
+			xcb_generic_error_t* error = NULL;
+
+			if (!replied || !xcb_poll_for_reply(xhandler.connection, pending->cookie.sequence, (void**)&reply, &error)) {
+				replied = false;
+				node = next;
+				continue;
+			}
+			pending->requested = false;
+
+			if (error || !reply) {
+				/* the window was destroyed before the reply */
+				pending_free(pending_remove(node));
+			}
+			else if (reply_get_resource_name(reply, resource)) {
+				pending_remove(node);
+				pending_admit(pending, resource, handler);
+				pending_free(pending);
+			}
+			else if (wincache_get_parent(pending->window) != DefaultRootWindow(monitor.display)) {
+				/* child windows rarely get the class set later, so stop tracking them until
+				   the class property change notification queues them again */
+				pending_remove(node);
+				if (pending->damage) XDamageDestroy(monitor.display, pending->damage);
+				pending_free(pending);
+			}
+			/* otherwise the window class is not set yet, wait until the window is mapped */
+			free(reply);
+			free(error);
+		}
+		else {
+			if (!now.tv_sec) gettimeofday(&now, NULL);
+			/* stop tracking windows that didn't get the class in time, the class property
+			   change notification queues them again */
+			if (check_timeval_timeout(&pending->queued, &now, WINDOW_PENDING_TIMEOUT)) {
+				pending_remove(node);
+				if (pending->damage) XDamageDestroy(monitor.display, pending->damage);
+				pending_free(pending);
+			}
+		}
+		node = next;
+	}
+}
+
+
+void window_register_damage(window_t* win, Time timestamp)
+{
+	if (timestamp - win->rate_start >= 1000) {
+		win->rate = win->rate_start ? win->rate_count * 1000 / (timestamp - win->rate_start) : 0;
+		win->rate_start = timestamp;
+		win->rate_count = 0;
+	}
+	win->rate_count++;
+}
+
+
+unsigned int window_get_damage_rate(window_t* win)
+{
+	/* the number of events in the current period is the lower limit of the rate */
+	return win->rate > win->rate_count ? win->rate : win->rate_count;
+}
+
+
 /**
  * Dump the contents of the monitored windows list.
  *
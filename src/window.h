@@ -47,6 +47,8 @@
 #ifndef _WINDOW_H_
 #define _WINDOW_H_
 
+#include <stdint.h>
+
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
 #include <X11/XKBlib.h>
@@ -68,9 +70,30 @@ typedef struct _window_t {
 	Damage damage;
 	/* the owner application */
 	application_t* application;
+	/* the Present event context, 0 if frame completion is not monitored */
+	uint32_t present;
+	/* the damage rate measurement period start */
+	Time rate_start;
+	/* number of damage events in the current rate measurement period */
+	unsigned int rate_count;
+	/* the damage rate (events per second) of the last measurement period */
+	unsigned int rate;
 } window_t;
 
 
+/* the maximum number of damage events buffered for a window waiting for admission */
+#define WINDOW_PENDING_DAMAGE_MAX	256
+
+/* the time (ms) a window without resource name waits for admission */
+#define WINDOW_PENDING_TIMEOUT		2000
+
+/**
+ * Damage event handler, used to process damage buffered for windows waiting
+ * for admission.
+ */
+typedef void (*window_damage_handler_t)(XDamageNotifyEvent* dev);
+
+
 /**
  * Initializes window monitor.
  *
@@ -85,6 +108,16 @@ void window_init(Display* display);
 void window_fini();
 
 
+/**
+ * Resets the window monitor at the end of a measurement session.
+ *
+ * The monitored windows and their damage contexts are kept for the next
+ * session in daemon mode. The windows of applications not monitored by the
+ * next session are removed by window_monitor_all().
+ */
+void window_reset();
+
+
 /**
  * Sets the damage reporting level.
  *
@@ -96,6 +129,28 @@ void window_fini();
 void window_set_damage_level(int level);
 
 
+/**
+ * Switches to root damage mode.
+ *
+ * In root damage mode a single damage object is created for the root window
+ * instead of creating damage objects for every monitored window. The damage
+ * is attributed to the windows with the client side stacking order index
+ * (see stacking.h). Must be called before monitoring is started.
+ * @return   true if the root window damage object was created.
+ */
+bool window_monitor_root_damage();
+
+
+/**
+ * Checks if the damage object is the root window damage object created
+ * in root damage mode.
+ *
+ * @param[in] damage   the damage object.
+ * @return             true if the damage object is the root damage object.
+ */
+bool window_is_root_damage(Damage damage);
+
+
 /**
  * Searches monitored window list for the specified window.
  *
@@ -105,13 +160,28 @@ void window_set_damage_level(int level);
 window_t* window_find(Window window);
 
 
+/**
+ * Finds the monitored window containing the specified window.
+ *
+ * The window ancestry is resolved from the window tree mirror (see wincache.h),
+ * so normally no server round trips are needed. The root window is not
+ * considered as it's monitored only for screen updates.
+ * @param[in] window   the window.
+ * @return             the window itself, its nearest monitored ancestor
+ *                     or NULL if neither is monitored.
+ */
+window_t* window_find_ancestor(Window window);
+
+
 /**
  * Retrieves resource (application) name associated with the window.
  *
  * The root windows is aliased as '*'.
+ * The resource names are cached, so only the first call for a window
+ * (or the first call after its WM_CLASS property changes) makes a server round trip.
  * @param[in] window  the window which resource name should be retrieved.
- * @return            a reference to the resource name or NULL. This name will be changed
- *                    by another window_get_resource_name call, so don't store the reference
+ * @return            a reference to the resource name or NULL. The reference can become
+ *                    invalid when window events are processed, so don't store the reference
  *                    but copy contents if needed.
  */
 const char* window_get_resource_name(Window window);
@@ -134,28 +204,36 @@ window_t* window_try_monitor(Window window);
  * Start to monitor all windows in list.
  *
  * This function is called in the beginning, to start monitoring all windows
- * which was added manually with --id option.
+ * which was added manually with --id option or kept from the previous session.
+ * The kept windows of applications no longer monitored are removed.
  */
 void window_monitor_all();
 
 
 
 /**
- * Tries to monitor children of the specified window.
+ * Starts scanning the window tree for windows to monitor.
  *
- * This function will try to monitor every child of the specified window.
- * If monitoring a child fails, it will try to monitor its children.
- * @param[in] window  the window which children to monitor.
+ * The window tree is scanned breadth first, sending the children and
+ * WM_CLASS property requests for all windows of a tree level before
+ * waiting for the replies. This function sends only the first request, so
+ * the server can process it while the command line options are parsed.
+ * @param[in] window  the window which subtree to scan.
  */
-void window_try_monitor_children(Window window);
+void window_scan_begin(Window window);
 
 
 /**
- * Checks if the monitored windows list is empty.
+ * Completes the window tree scan started with window_scan_begin().
+ *
+ * Every scanned window is tried to be monitored. If monitoring a window
+ * fails, its children are scanned in the next level. The number of scanned
+ * windows and the time spent are reported.
  *
- * @return   true if the monitored windows list is empty.
+ * If no scan was started, the window tree mirrored by window cache is
+ * scanned instead without server round trips.
  */
-bool window_empty();
+void window_scan_end();
 
 
 /**
@@ -173,5 +251,86 @@ void window_remove(window_t* win);
 window_t* window_add(Window window, application_t* application);
 
 
+/**
+ * Queues newly created window for admission.
+ *
+ * The window resource name is requested asynchronously and the window
+ * is admitted (or dropped) when the reply is processed by window_process_pending().
+ * The damage monitoring of mapped windows starts immediately, unmapped windows
+ * are monitored when mapped (see window_requeue()). Meanwhile received damage
+ * events are buffered. Child windows without resource name are dropped from
+ * the queue, while top level windows wait until they are mapped, for
+ * WINDOW_PENDING_TIMEOUT at most.
+ * @param[in] window   the window to queue.
+ * @param[in] mapped   true if the window can be mapped already.
+ */
+void window_queue(Window window, bool mapped);
+
+
+/**
+ * Removes window from admission queue.
+ *
+ * @param[in] window   the window to remove.
+ */
+void window_unqueue(Window window);
+
+
+/**
+ * Checks if the window is waiting for admission.
+ *
+ * @param[in] window   the window.
+ * @return             true if the window is queued.
+ */
+bool window_is_queued(Window window);
+
+
+/**
+ * Requests resource name again for a queued window.
+ *
+ * Clients often set the window class after creating window, so the
+ * resource name is requested again when the window is mapped.
+ * @param[in] window   the window.
+ * @param[in] mapped   true if the window was mapped, starting its damage monitoring.
+ */
+void window_requeue(Window window, bool mapped);
+
+
+/**
+ * Buffers damage event if the damaged window is waiting for admission.
+ *
+ * @param[in] dev   the damage event.
+ * @return          true if the event was buffered.
+ */
+bool window_buffer_damage(XDamageNotifyEvent* dev);
+
+
+/**
+ * Processes received replies for the queued windows.
+ *
+ * Windows belonging to monitored applications are added to the monitored
+ * windows list and their buffered damage is passed to the damage handler.
+ * Other windows are dropped. This function never blocks.
+ * @param[in] handler   the damage event handler.
+ */
+void window_process_pending(window_damage_handler_t handler);
+
+
+/**
+ * Registers window damage event for damage rate calculation.
+ *
+ * @param[in] win         the damaged window.
+ * @param[in] timestamp   the damage event timestamp.
+ */
+void window_register_damage(window_t* win, Time timestamp);
+
+
+/**
+ * Retrieves window damage rate.
+ *
+ * @param[in] win   the window.
+ * @return          the number of damage events per second.
+ */
+unsigned int window_get_damage_rate(window_t* win);
+
 #endif
 
@@ -29,8 +29,15 @@
  * OF THIS SOFTWARE.
  */
 
+#include <glib.h>
+
+#include <xcb/damage.h>
+#include <xcb/present.h>
+#include <X11/extensions/XI2proto.h>
+
 #include "xhandler.h"
 #include "xinput.h"
+#include "present.h"
 #include "xemu.h"
 #include "xresponse.h"
 
@@ -39,14 +46,26 @@
 /* environment variables used for xresponse configuration (optional) */
 #define ENV_POINTER_INPUT_DEVICE     "XRESPONSE_POINTER_INPUT_DEVICE"
 #define ENV_KEYBOARD_INPUT_DEVICE    "XRESPONSE_KEYBOARD_INPUT_DEVICE"
+#define ENV_EVENT_BACKEND            "XRESPONSE_EVENT_BACKEND"
 
 
 xhandler_t xhandler = {
 		.damage_event_num = 0,
 		.timestamp_atom = None,
 		.display = NULL,
+		.connection = NULL,
+		.backend = XHANDLER_BACKEND_XCB,
 };
 
+/* XCB events read while waiting for a specific event (xcb_generic_event_t) */
+static GQueue deferred_events = G_QUEUE_INIT;
+
+/* the data of the last converted XInput2 raw event */
+static XIRawEvent raw_event;
+
+/* the data of the last converted Present complete notify event */
+static xcb_present_complete_notify_event_t present_event;
+
 static const char* default_pointer_device = XINPUT_POINTER_DEVICE;
 static const char* default_keyboard_device = XINPUT_KEYBOARD_DEVICE;
 
@@ -115,17 +134,277 @@ static xemu_device_t xhandler_open_device(XDeviceInfo *devInfo, int count, int t
 }
 
 
+/**
+ * Reports XCB error with the Xlib error handler.
+ *
+ * With XCB backend the errors of requests without replies are received
+ * as events.
+ * @param[in] error   the error.
+ */
+static void xcb_handle_error(xcb_generic_error_t* error)
+{
+	XErrorEvent xerror = {
+			.type = 0,
+			.display = xhandler.display,
+			.resourceid = error->resource_id,
+			.serial = error->full_sequence,
+			.error_code = error->error_code,
+			.request_code = error->major_code,
+			.minor_code = error->minor_code,
+	};
+	xhandler_xerror(xhandler.display, &xerror);
+}
+
+
+/**
+ * Converts XCB event into Xlib event structure.
+ *
+ * Only the events processed by xresponse are fully converted, for other
+ * events only the common fields are set.
+ * @param[in] event    the XCB event.
+ * @param[out] xev     the Xlib event.
+ */
+static void xcb_convert_event(xcb_generic_event_t* event, XEvent* xev)
+{
+	int type = event->response_type & ~0x80;
+
+	xev->xany.type = type;
+	xev->xany.serial = event->full_sequence;
+	xev->xany.send_event = (event->response_type & 0x80) != 0;
+	xev->xany.display = xhandler.display;
+	xev->xany.window = None;
+
+	if (type == xhandler.damage_event_num + XDamageNotify) {
+		xcb_damage_notify_event_t* ev = (xcb_damage_notify_event_t*)event;
+		XDamageNotifyEvent* dev = (XDamageNotifyEvent*)xev;
+		dev->drawable = ev->drawable;
+		dev->damage = ev->damage;
+		dev->level = ev->level & ~DamageNotifyMore;
+		dev->more = (ev->level & DamageNotifyMore) != 0;
+		dev->timestamp = ev->timestamp;
+		dev->area.x = ev->area.x;
+		dev->area.y = ev->area.y;
+		dev->area.width = ev->area.width;
+		dev->area.height = ev->area.height;
+		dev->geometry.x = ev->geometry.x;
+		dev->geometry.y = ev->geometry.y;
+		dev->geometry.width = ev->geometry.width;
+		dev->geometry.height = ev->geometry.height;
+		return;
+	}
+
+	switch (type) {
+	case GenericEvent: {
+		xcb_ge_generic_event_t* ev = (xcb_ge_generic_event_t*)event;
+		xev->xcookie.extension = ev->extension;
+		xev->xcookie.evtype = ev->event_type;
+		xev->xcookie.cookie = 0;
+		xev->xcookie.data = NULL;
+		/* only the raw event fields used for input monitoring are converted */
+		if (ev->extension == xrecord.xi_opcode && ev->event_type >= XI_RawKeyPress &&
+				ev->event_type <= XI_RawMotion) {
+			xXIRawEvent* raw = (xXIRawEvent*)event;
+			memset(&raw_event, 0, sizeof(raw_event));
+			raw_event.type = type;
+			raw_event.serial = xev->xany.serial;
+			raw_event.display = xhandler.display;
+			raw_event.extension = ev->extension;
+			raw_event.evtype = raw->evtype;
+			raw_event.time = raw->time;
+			raw_event.deviceid = raw->deviceid;
+			raw_event.sourceid = raw->sourceid;
+			raw_event.detail = raw->detail;
+			raw_event.flags = raw->flags;
+			xev->xcookie.data = &raw_event;
+		}
+		else if (ev->extension == present.opcode && ev->event_type == XCB_PRESENT_COMPLETE_NOTIFY) {
+			memcpy(&present_event, event, sizeof(present_event));
+			xev->xcookie.data = &present_event;
+		}
+		break;
+	}
+	case CreateNotify: {
+		xcb_create_notify_event_t* ev = (xcb_create_notify_event_t*)event;
+		xev->xcreatewindow.parent = ev->parent;
+		xev->xcreatewindow.window = ev->window;
+		xev->xcreatewindow.x = ev->x;
+		xev->xcreatewindow.y = ev->y;
+		xev->xcreatewindow.width = ev->width;
+		xev->xcreatewindow.height = ev->height;
+		xev->xcreatewindow.border_width = ev->border_width;
+		xev->xcreatewindow.override_redirect = ev->override_redirect;
+		break;
+	}
+	case DestroyNotify: {
+		xcb_destroy_notify_event_t* ev = (xcb_destroy_notify_event_t*)event;
+		xev->xdestroywindow.event = ev->event;
+		xev->xdestroywindow.window = ev->window;
+		break;
+	}
+	case UnmapNotify: {
+		xcb_unmap_notify_event_t* ev = (xcb_unmap_notify_event_t*)event;
+		xev->xunmap.event = ev->event;
+		xev->xunmap.window = ev->window;
+		xev->xunmap.from_configure = ev->from_configure;
+		break;
+	}
+	case MapNotify: {
+		xcb_map_notify_event_t* ev = (xcb_map_notify_event_t*)event;
+		xev->xmap.event = ev->event;
+		xev->xmap.window = ev->window;
+		xev->xmap.override_redirect = ev->override_redirect;
+		break;
+	}
+	case ReparentNotify: {
+		xcb_reparent_notify_event_t* ev = (xcb_reparent_notify_event_t*)event;
+		xev->xreparent.event = ev->event;
+		xev->xreparent.window = ev->window;
+		xev->xreparent.parent = ev->parent;
+		xev->xreparent.x = ev->x;
+		xev->xreparent.y = ev->y;
+		xev->xreparent.override_redirect = ev->override_redirect;
+		break;
+	}
+	case ConfigureNotify: {
+		xcb_configure_notify_event_t* ev = (xcb_configure_notify_event_t*)event;
+		xev->xconfigure.event = ev->event;
+		xev->xconfigure.window = ev->window;
+		xev->xconfigure.above = ev->above_sibling;
+		xev->xconfigure.x = ev->x;
+		xev->xconfigure.y = ev->y;
+		xev->xconfigure.width = ev->width;
+		xev->xconfigure.height = ev->height;
+		xev->xconfigure.border_width = ev->border_width;
+		xev->xconfigure.override_redirect = ev->override_redirect;
+		break;
+	}
+	case GravityNotify: {
+		xcb_gravity_notify_event_t* ev = (xcb_gravity_notify_event_t*)event;
+		xev->xgravity.event = ev->event;
+		xev->xgravity.window = ev->window;
+		xev->xgravity.x = ev->x;
+		xev->xgravity.y = ev->y;
+		break;
+	}
+	case CirculateNotify: {
+		xcb_circulate_notify_event_t* ev = (xcb_circulate_notify_event_t*)event;
+		xev->xcirculate.event = ev->event;
+		xev->xcirculate.window = ev->window;
+		xev->xcirculate.place = ev->place;
+		break;
+	}
+	case PropertyNotify: {
+		xcb_property_notify_event_t* ev = (xcb_property_notify_event_t*)event;
+		xev->xproperty.window = ev->window;
+		xev->xproperty.atom = ev->atom;
+		xev->xproperty.time = ev->time;
+		xev->xproperty.state = ev->state;
+		break;
+	}
+	}
+}
+
+
+/**
+ * Retrieves the next event without blocking.
+ *
+ * The XCB backend reads the connection only when no more events are
+ * queued, so the events received together are processed without system
+ * calls.
+ * @param[out] event_return   the retrieved event.
+ * @return                    true if an event was retrieved.
+ */
+static bool poll_event(XEvent* event_return)
+{
+	if (xhandler.backend == XHANDLER_BACKEND_XLIB) {
+		if (!XPending(xhandler.display)) return false;
+		XNextEvent(xhandler.display, event_return);
+		return true;
+	}
+	while (true) {
+		xcb_generic_event_t* event = g_queue_pop_head(&deferred_events);
+		if (!event) event = xcb_poll_for_queued_event(xhandler.connection);
+		if (!event) event = xcb_poll_for_event(xhandler.connection);
+		if (!event) return false;
+
+		if (event->response_type == 0) {
+			xcb_handle_error((xcb_generic_error_t*)event);
+			free(event);
+			continue;
+		}
+		xcb_convert_event(event, event_return);
+		free(event);
+		return true;
+	}
+}
+
+
+/**
+ * Waits for the next event.
+ *
+ * @param[out] event_return   the retrieved event.
+ */
+static void wait_event(XEvent* event_return)
+{
+	if (xhandler.backend == XHANDLER_BACKEND_XLIB) {
+		XNextEvent(xhandler.display, event_return);
+		return;
+	}
+	while (!poll_event(event_return)) {
+		xcb_generic_event_t* event = xcb_wait_for_event(xhandler.connection);
+		if (!event) {
+			fprintf(stderr, "X server connection lost\n");
+			exit(1);
+		}
+		g_queue_push_tail(&deferred_events, event);
+	}
+}
+
+
+/**
+ * Checks if the event is the timestamp property change notification.
+ *
+ * Used to wait for the timestamp property change without removing other
+ * property change notifications from the event queue.
+ */
+static Bool is_timestamp_event(Display* __attribute__((unused)) dpy, XEvent* xevent, XPointer __attribute__((unused)) arg)
+{
+	return xevent->type == PropertyNotify && xevent->xproperty.atom == xhandler.timestamp_atom &&
+			xevent->xproperty.window == DefaultRootWindow(xhandler.display);
+}
+
+
 Time xhandler_get_server_time()
 {
+	XEvent xevent;
+
 	XChangeProperty(xhandler.display, DefaultRootWindow(xhandler.display), xhandler.timestamp_atom, xhandler.timestamp_atom, 8, PropModeReplace,
 			(unsigned char*) "a", 1);
-	for (;;) {
-		XEvent xevent;
+	if (xhandler.backend == XHANDLER_BACKEND_XLIB) {
+		XIfEvent(xhandler.display, &xevent, is_timestamp_event, NULL);
+		return xevent.xproperty.time;
+	}
 
-		XMaskEvent(xhandler.display, PropertyChangeMask, &xevent);
-		if (xevent.xproperty.atom == xhandler.timestamp_atom)
-			return xevent.xproperty.time;
+	/* keep the other events for later processing */
+	XFlush(xhandler.display);
+	GQueue events = G_QUEUE_INIT;
+	xcb_generic_event_t* event;
+	Time timestamp = CurrentTime;
+	while ((event = xcb_wait_for_event(xhandler.connection))) {
+		if (event->response_type != 0) {
+			xcb_convert_event(event, &xevent);
+			if (is_timestamp_event(xhandler.display, &xevent, NULL)) {
+				timestamp = xevent.xproperty.time;
+				free(event);
+				break;
+			}
+		}
+		g_queue_push_tail(&events, event);
 	}
+	while ((event = g_queue_pop_head(&events))) {
+		g_queue_push_tail(&deferred_events, event);
+	}
+	return timestamp;
 }
 
 
@@ -135,23 +414,22 @@ bool xhandler_get_xevent_timed(XEvent *event_return, struct timeval *tv)
 		return False;
 
 	if (tv == NULL) {
-		XNextEvent(xhandler.display, event_return);
+		wait_event(event_return);
 		return True;
 	}
 
 	XFlush(xhandler.display);
 
-	if (xrecord.display && XPending(xrecord.display)) {
-		XRecordProcessReplies(xrecord.display);
+	if (xrecord.enabled) {
+		xinput_process();
 	}
-	if (XPending(xhandler.display) != 0) {
-		XNextEvent(xhandler.display, event_return);
+	if (poll_event(event_return)) {
 		return True;
 	}
 
 	while (True) {
 		int fd = ConnectionNumber(xhandler.display);
-		int fdrec = 0;
+		int fdrec = -1;
 		fd_set readset;
 		int maxfd = fd;
 		int rc;
@@ -159,8 +437,8 @@ bool xhandler_get_xevent_timed(XEvent *event_return, struct timeval *tv)
 		FD_ZERO(&readset);
 		FD_SET(fd, &readset);
 
-		if (xrecord.display) {
-			fdrec = ConnectionNumber(xrecord.display);
+		if (xrecord.enabled && xrecord.fd >= 0) {
+			fdrec = xrecord.fd;
 			FD_SET(fdrec, &readset);
 			maxfd = fdrec > fd ? fdrec : fd;
 		}
@@ -171,12 +449,13 @@ bool xhandler_get_xevent_timed(XEvent *event_return, struct timeval *tv)
 			return False;
 		}
 
-		if (xrecord.display && FD_ISSET(fdrec, &readset)) {
-			XRecordProcessReplies(xrecord.display);
+		if (fdrec >= 0 && FD_ISSET(fdrec, &readset)) {
+			xinput_process();
 		}
 		if (FD_ISSET(fd, &readset)) {
-			XNextEvent(xhandler.display, event_return);
-			return True;
+			/* the data might be a reply to an asynchronous request instead of an event,
+			 * return to let the caller process the reply */
+			return poll_event(event_return);
 		}
 	}
 }
@@ -193,6 +472,18 @@ bool xhandler_init(const char *dpy_name)
 		fprintf(stderr, "Unable to connect to DISPLAY.\n");
 		return false;
 	}
+	xhandler.connection = XGetXCBConnection(xhandler.display);
+
+	/* The events are read directly from XCB connection unless Xlib backend is requested.
+	 * Must be set before any event is received */
+	const char* backend = getenv(ENV_EVENT_BACKEND);
+	if (backend && !strcmp(backend, "xlib")) {
+		xhandler.backend = XHANDLER_BACKEND_XLIB;
+	}
+	if (xhandler.backend == XHANDLER_BACKEND_XCB) {
+		XSetEventQueueOwner(xhandler.display, XCBOwnsEventQueue);
+	}
+
 	/* Check the extensions we need are available */
 
 	if (!XTestQueryExtension(xhandler.display, &unused, &unused, &unused, &unused)) {
@@ -250,23 +541,36 @@ bool xhandler_init(const char *dpy_name)
  */
 void xhandler_eat_damage()
 {
-	while (XPending(xhandler.display)) {
-		xevent_t e;
-
-		XNextEvent(xhandler.display, &e.ev);
+	xevent_t e;
 
+	while (poll_event(&e.ev)) {
 		if (e.ev.type == xhandler.damage_event_num + XDamageNotify) {
-			XDamageSubtract(xhandler.display, e.dev.damage, None, None);
+			xhandler_damage_subtract(e.dev.damage);
 		}
 	}
 }
 
 
+void xhandler_damage_subtract(Damage damage)
+{
+	if (xhandler.backend == XHANDLER_BACKEND_XLIB) {
+		XDamageSubtract(xhandler.display, damage, None, None);
+	}
+	else {
+		xcb_damage_subtract(xhandler.connection, damage, XCB_NONE, XCB_NONE);
+	}
+}
+
+
 /**
  * Releases resources allocated by X event handler.
  */
 void xhandler_fini()
 {
+	xcb_generic_event_t* event;
+	while ((event = g_queue_pop_head(&deferred_events))) {
+		free(event);
+	}
 	XCloseDisplay(xhandler.display);
 }
 
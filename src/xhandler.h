@@ -43,6 +43,7 @@
 #include <stdbool.h>
 
 #include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/keysym.h>
 #include <X11/XKBlib.h>
 #include <X11/Xutil.h>
@@ -51,6 +52,14 @@
 #include <X11/extensions/Xdamage.h>
 #include <X11/extensions/record.h>
 
+/**
+ * X event retrieval backends.
+ */
+enum {
+	XHANDLER_BACKEND_XLIB, /* events are read with Xlib */
+	XHANDLER_BACKEND_XCB,  /* events are read directly from XCB connection */
+};
+
 typedef struct {
 	int damage_event_num; /* Damage Ext Event ID */
 
@@ -58,6 +67,10 @@ typedef struct {
 
 	Display* display;  /* the connected display */
 
+	xcb_connection_t* connection; /* XCB connection of the display, used for asynchronous requests */
+
+	int backend; /* the event retrieval backend (XHANDLER_BACKEND_*) */
+
 } xhandler_t;
 
 extern xhandler_t xhandler;
@@ -72,6 +85,7 @@ typedef union {
 	XUnmapEvent uev;
 	XMapEvent mev;
 	XDestroyWindowEvent dstev;
+	XReparentEvent rev;
 } xevent_t;
 
 /**
@@ -91,9 +105,26 @@ void xhandler_fini();
 void xhandler_eat_damage();
 
 
+/**
+ * Marks the damage object as repaired.
+ *
+ * @param[in] damage   the damage object.
+ */
+void xhandler_damage_subtract(Damage damage);
+
+
 /**
  * Get an X event with a timeout ( in secs ). The timeout is
  * updated for the number of secs left.
+ *
+ * By default the events are read from XCB connection and converted to Xlib
+ * event structures without Xlib event queue locking and conversion. Xlib
+ * backend can be selected by setting XRESPONSE_EVENT_BACKEND environment
+ * variable to 'xlib'.
+ *
+ * The XCB backend sets the data of XInput2 raw event and Present complete
+ * notify event cookies directly, without XGetEventData() call. The data is valid until the next event
+ * is retrieved.
  */
 bool xhandler_get_xevent_timed(XEvent *event_return, struct timeval *tv);
 
@@ -35,226 +35,466 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <glib.h>
 
 #include "xinput.h"
 #include "application.h"
 #include "window.h"
 #include "report.h"
+#include "idle.h"
+#include "wincache.h"
+#include "xhandler.h"
+#include "scheduler.h"
+#include "stacking.h"
+
+
+/* the input record queue size, must be power of two */
+#define XINPUT_QUEUE_SIZE	1024
+
+/* the pointer motion gap (msecs) ending the current motion segment */
+#define XINPUT_MOTION_GAP	100
+
+/* environment variable selecting the input monitoring backend (optional) */
+#define ENV_INPUT_BACKEND	"XRESPONSE_INPUT_BACKEND"
+
+/**
+ * Captured input event.
+ */
+typedef struct {
+	/* the event type */
+	int type;
+	/* the key code or button number */
+	int detail;
+	/* the event timestamp */
+	Time time;
+	/* the pointer position */
+	int x, y;
+	/* the time the event was received from the server (nsecs, monotonic clock) */
+	uint64_t received;
+} input_record_t;
+
+
+/**
+ * Single producer, single consumer input record queue.
+ *
+ * The capture thread writes only the tail index and the main thread
+ * only the head index, so no locking is needed.
+ */
+typedef struct {
+	/* the input records */
+	input_record_t records[XINPUT_QUEUE_SIZE];
+	/* the index of the next record to read, updated by the main thread */
+	unsigned int head;
+	/* the index of the next record to write, updated by the capture thread */
+	unsigned int tail;
+	/* the number of records dropped because of full queue */
+	unsigned int dropped;
+} input_queue_t;
+
+
+/**
+ * Pointer motion segment.
+ *
+ * Consecutive pointer motion events are coalesced into segments, which
+ * are reported when a button or key event is received or after a gap
+ * in the motion events.
+ */
+typedef struct {
+	/* the number of motion events */
+	unsigned int count;
+	/* the first and last event timestamps */
+	Time start, end;
+	/* the start and end positions */
+	int x1, y1, x2, y2;
+	/* the length of the pointer path */
+	double length;
+	/* the time the last motion event was processed */
+	struct timeval last;
+} motion_segment_t;
+
+
+/**
+ * Binary pointer motion log record.
+ */
+typedef struct {
+	uint32_t time;
+	int16_t x;
+	int16_t y;
+} motion_log_record_t;
+
+
+/**
+ * Pointer axis of XInput2 slave device.
+ */
+typedef struct {
+	/* true if the axis reports absolute positions */
+	bool absolute;
+	/* the axis range, mapped to the screen dimension if min < max */
+	double min, max;
+} pointer_axis_t;
+
+
+/**
+ * Input event delivery statistics.
+ */
+typedef struct {
+	/* the number of processed events */
+	unsigned int count;
+	/* the total time between receiving and processing of events (nsecs) */
+	uint64_t queued;
+	/* the delivery delay (usecs) between the event timestamps and receiving the events */
+	int64_t delay_min, delay_max, delay_sum;
+} input_stats_t;
 
 
 /* the xrecord data */
 xrecord_t xrecord = {
-		.display = NULL,
+		.backend = XINPUT_BACKEND_RECORD,
+		.xi_opcode = 0,
+		.connection = NULL,
 		.context = 0,
+		.fd = -1,
 		.enabled = false,
 		.motion = false,
 };
 
-/* Needed for client window checking */
-static Atom wmstate_atom = None;
-
 /* the default display */
 static Display* display = NULL;
 
+/* the captured input records */
+static input_queue_t queue;
+
+/* the input capture thread */
+static pthread_t capture_thread_id;
+
+/* the write end of the capture notification pipe */
+static int notify_fd = -1;
+
+/* the current pointer motion segment */
+static motion_segment_t motion;
+
+/* the binary pointer motion log */
+static FILE* motion_log = NULL;
+
+/* the input event delivery statistics */
+static input_stats_t stats;
+
+/* the pointer position tracked from XInput2 raw events */
+static double pointer_x, pointer_y;
+
+/* the x and y axes of XInput2 slave pointer devices (pointer_axis_t[2]), indexed by device id */
+static GHashTable* pointer_devices = NULL;
+
 /**
+ * Retrieves the monotonic clock time.
+ *
+ * @return   the current time (nsecs).
  */
-static bool window_has_property(Display * dpy, Window win, Atom atom)
+static uint64_t get_monotonic_time()
 {
-	Atom type_ret;
-	int format_ret;
-	unsigned char *prop_ret;
-	unsigned long bytes_after, num_ret;
-
-	type_ret = None;
-	prop_ret = NULL;
-	XGetWindowProperty(dpy, win, atom, 0, 0, False, AnyPropertyType, &type_ret, &format_ret, &num_ret, &bytes_after,
-			&prop_ret);
-	if (prop_ret)
-		XFree(prop_ret);
-
-	return (type_ret != None) ? true : false;
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
-/*
- * Check if window is viewable
+
+/**
+ * Finds the monitored window at the specified position.
+ *
+ * The top level window is found in the mirrored stacking order and its
+ * client window in the window tree mirror, without server round trips.
+ * @param[in] x   the x coordinate.
+ * @param[in] y   the y coordinate.
+ * @return        the monitored window or NULL.
  */
-static bool window_is_viewable(Display * dpy, Window win)
+static window_t* find_window_at(int x, int y)
 {
-	bool rc;
-	XWindowAttributes xwa;
-	XGetWindowAttributes(dpy, win, &xwa);
-	rc = (xwa.class == InputOutput) && (xwa.map_state == IsViewable);
+	Window toplevel = stacking_find_window(x, y);
+	Window client = wincache_find_client(toplevel);
+	return window_find_ancestor(client == None ? toplevel : client);
+}
 
-	return rc;
+
+/**
+ * Reports the current pointer motion segment.
+ */
+static void motion_flush()
+{
+	if (!motion.count) return;
+
+	report_add_message(motion.start, "Pointer moved from %dx%d to %dx%d (%u events, %lu ms, path %.0f px)\n",
+			motion.x1, motion.y1, motion.x2, motion.y2, motion.count, motion.end - motion.start, motion.length);
+	motion.count = 0;
 }
 
+
 /**
- * Finds client window for window reported at the cursor location.
+ * Adds pointer motion event to the current motion segment.
+ *
+ * @param[in] record   the motion event record.
  */
-static Window window_find_client(Display* dpy, Window window)
+static void motion_add(const input_record_t* record)
 {
-	Window root, parent, win = None;
-	Window *children;
-	unsigned int n_children;
-	int i;
+	if (motion.count && record->time - motion.end > XINPUT_MOTION_GAP) {
+		motion_flush();
+	}
+	if (!motion.count) {
+		motion.start = record->time;
+		motion.x1 = record->x;
+		motion.y1 = record->y;
+		motion.x2 = motion.x1;
+		motion.y2 = motion.y1;
+		motion.length = 0;
+	}
+	else {
+		motion.length += hypot(record->x - motion.x2, record->y - motion.y2);
+	}
+	motion.count++;
+	motion.end = record->time;
+	motion.x2 = record->x;
+	motion.y2 = record->y;
+	gettimeofday(&motion.last, NULL);
+}
 
-	if (!XQueryTree(dpy, window, &root, &parent, &children, &n_children))
-		return None;
-	if (!children)
-		return None;
 
-	display = dpy;
+/**
+ * Updates the input event delivery statistics.
+ *
+ * @param[in] record   the input record.
+ */
+static void stats_add(const input_record_t* record)
+{
+	/* the X server timestamps are milliseconds of the monotonic clock, truncated
+	 * to 32 bits, so for local servers the delay is the real delivery delay */
+	uint64_t received = record->received / 1000;
+	int64_t delay = (int64_t)(int32_t)((uint32_t)(received / 1000) - (uint32_t)record->time) * 1000 +
+			received % 1000;
+
+	if (!stats.count || delay < stats.delay_min) stats.delay_min = delay;
+	if (!stats.count || delay > stats.delay_max) stats.delay_max = delay;
+	stats.delay_sum += delay;
+	stats.queued += get_monotonic_time() - record->received;
+	stats.count++;
+}
+
 
-	/* Check each child for WM_STATE and other validity */
-	for (i = (int) n_children - 1; i >= 0; i--) {
-		if (!window_is_viewable(dpy, children[i])) {
-			children[i] = None; /* Don't bother descending into this one */
-			continue;
+/**
+ * Processes captured input record.
+ *
+ * @param[in] record   the input record.
+ */
+static void process_record(const input_record_t* record)
+{
+	int x = record->x, y = record->y;
+	window_t* win;
+	application_t* app = NULL;
+	char extInfo[256] = "";
+
+	stats_add(record);
+	idle_register_input(record->time);
+
+	/* the echo of an event injected by xresponse */
+	injection_t injection;
+	bool injected = scheduler_match_injection(record->type, record->detail, &injection);
+	int delivery = injected ? (int64_t)(record->received - injection.sent) / 1000 : -1;
+
+	/* report the pointer motion preceding button and key events */
+	if (record->type != MotionNotify) {
+		motion_flush();
+	}
+
+	switch (record->type) {
+	case ButtonPress:
+		win = find_window_at(x, y);
+		if (win) {
+			app = win->application;
+			sprintf(extInfo, "(%s)", app->name);
 		}
-		if (!window_has_property(dpy, children[i], wmstate_atom)) {
-			continue;
+		report_add_message(record->time, "Button %x pressed at %dx%d %s\n", record->detail, x, y,
+				extInfo);
+		if (response.timeout) {
+			application_set_user_action("press (%dx%d) %s", x, y, extInfo);
+			application_response_reset(record->time);
+			if (injected) application_response_set_delivery(injection.queued, delivery);
+			application_response_start(app);
 		}
+		break;
 
-		/* Got one */
-		win = children[i];
+	case ButtonRelease:
+		/* report any button press related response times */
+		application_response_report();
+
+		win = find_window_at(x, y);
+		if (win) {
+			sprintf(extInfo, "(%s)", win->application->name);
+		}
+		report_add_message(record->time, "Button %x released at %dx%d %s\n", record->detail, x, y,
+				extInfo);
+		if (response.timeout) {
+			application_set_user_action("release (%dx%d) %s", x, y, extInfo);
+			application_response_reset(record->time);
+			if (injected) application_response_set_delivery(injection.queued, delivery);
+		}
 		break;
-	}
 
-	/* No children matched, now descend into each child */
-	if (win == None) {
-		for (i = (int) n_children - 1; i >= 0; i--) {
-			if (children[i] == None)
-				continue;
-			win = window_find_client(dpy, children[i]);
-			if (win != None)
-				break;
+	case KeyPress:
+		report_add_message(record->time, "Key %s pressed\n", XKeysymToString(XKeycodeToKeysym(display,
+				record->detail, 0)));
+
+		if (response.timeout) {
+			application_set_user_action("key press (%s)",  XKeysymToString(XKeycodeToKeysym(display, record->detail, 0)));
+			application_response_reset(record->time);
+			if (injected) application_response_set_delivery(injection.queued, delivery);
+			application_response_start(app);
 		}
-	}
-	XFree(children);
+		break;
+
+	case KeyRelease:
+		/* report any button press related response times */
+		application_response_report();
+
+		report_add_message(record->time, "Key %s released\n", XKeysymToString(XKeycodeToKeysym(display,
+				record->detail, 0)));
+		if (response.timeout) {
+			application_set_user_action("key release (%s)",  XKeysymToString(XKeycodeToKeysym(display, record->detail, 0)));
+			application_response_reset(record->time);
+			if (injected) application_response_set_delivery(injection.queued, delivery);
+		}
+		break;
 
-	return win;
+	case MotionNotify:
+		if (motion_log) {
+			motion_log_record_t data = {.time = record->time, .x = record->x, .y = record->y};
+			fwrite(&data, sizeof(data), 1, motion_log);
+		}
+		if (xrecord.motion) {
+			motion_add(record);
+		}
+		break;
+
+	default:
+		fprintf(stderr, "Unknown device event type %d\n", record->type);
+		break;
+	}
 }
 
+
 /**
- * Finds client window at the cursor location.
+ * Adds input record to the queue.
  *
+ * Called only by the capture thread.
+ * @param[in] record   the input record.
+ * @return             false if the queue is full.
  */
-static Window get_window_at_cursor(Display* dpy)
+static bool queue_push(const input_record_t* record)
 {
-	Window root, child, client;
-	int root_x, root_y, win_x, win_y;
-	unsigned mask;
+	unsigned int tail = queue.tail;
 
-	XQueryPointer(dpy, DefaultRootWindow(dpy), &root, &child, &root_x, &root_y, &win_x, &win_y, &mask);
+	if (tail - __atomic_load_n(&queue.head, __ATOMIC_ACQUIRE) == XINPUT_QUEUE_SIZE) return false;
 
-	if (!wmstate_atom)
-		return child;
-
-	client = window_find_client(dpy, child);
-	return client == None ? child : client;
+	queue.records[tail & (XINPUT_QUEUE_SIZE - 1)] = *record;
+	__atomic_store_n(&queue.tail, tail + 1, __ATOMIC_RELEASE);
+	return true;
 }
 
 
-static void xrecord_callback(XPointer closure, XRecordInterceptData* data)
+/**
+ * Removes input record from the queue.
+ *
+ * Called only by the main thread.
+ * @param[out] record   the input record.
+ * @return              false if the queue is empty.
+ */
+static bool queue_pop(input_record_t* record)
 {
-	if (XRecordFromServer == data->category) {
-		Display* dpy = (Display*) closure;
-		xEvent* xev = (xEvent*) data->data;
-		int type = xev->u.u.type;
-		static int x, y;
-		window_t* win;
-		application_t* app = NULL;
-		char extInfo[256] = "";
-
-		switch (type) {
-		case ButtonPress:
-			win = window_find(get_window_at_cursor(dpy));
-
-			if (win) {
-				app = win->application;
-				sprintf(extInfo, "(%s)", app->name);
-			}
-			report_add_message(xev->u.keyButtonPointer.time, "Button %x pressed at %dx%d %s\n", xev->u.u.detail, x, y,
-					extInfo);
-			if (response.timeout) {
-				application_set_user_action("press (%dx%d) %s", x, y, extInfo);
-				application_response_reset(xev->u.keyButtonPointer.time);
-				application_response_start(app);
-			}
-			break;
+	unsigned int head = queue.head;
 
-		case ButtonRelease:
-			/* report any button press related response times */
-			application_response_report();
+	if (head == __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE)) return false;
 
-			/**/
-			win = window_find(get_window_at_cursor(dpy));
-			if (win) {
-				sprintf(extInfo, "(%s)", win->application->name);
-			}
-			report_add_message(xev->u.keyButtonPointer.time, "Button %x released at %dx%d %s\n", xev->u.u.detail, x, y,
-					extInfo);
-			if (response.timeout) {
-				application_set_user_action("release (%dx%d) %s", x, y, extInfo);
-				application_response_reset(xev->u.keyButtonPointer.time);
-			}
-			break;
-
-		case KeyPress:
-			report_add_message(xev->u.keyButtonPointer.time, "Key %s pressed\n", XKeysymToString(XKeycodeToKeysym(dpy,
-					xev->u.u.detail, 0)));
+	*record = queue.records[head & (XINPUT_QUEUE_SIZE - 1)];
+	__atomic_store_n(&queue.head, head + 1, __ATOMIC_RELEASE);
+	return true;
+}
 
-			if (response.timeout) {
-				application_set_user_action("key press (%s)",  XKeysymToString(XKeycodeToKeysym(dpy, xev->u.u.detail, 0)));
-				application_response_reset(xev->u.keyButtonPointer.time);
-				application_response_start(app);
-			}
-			break;
 
-		case KeyRelease:
-			/* report any button press related response times */
-			application_response_report();
+/**
+ * Queues the device events of the recorded data.
+ *
+ * @param[in] reply   the recorded data.
+ */
+static void capture_events(xcb_record_enable_context_reply_t* reply)
+{
+	uint8_t* data = xcb_record_enable_context_data(reply);
+	uint8_t* end = data + xcb_record_enable_context_data_length(reply);
+	/* every event is preceded by the server time */
+	int header_size = reply->element_header & XRecordFromServerTime ? sizeof(CARD32) : 0;
+
+	uint64_t received = get_monotonic_time();
+
+	while (data + header_size + sizeof(xEvent) <= end) {
+		xEvent* xev = (xEvent*)(data + header_size);
+		input_record_t record = {
+				.type = xev->u.u.type & 0x7f,
+				.detail = xev->u.u.detail,
+				.time = xev->u.keyButtonPointer.time,
+				.x = xev->u.keyButtonPointer.rootX,
+				.y = xev->u.keyButtonPointer.rootY,
+				.received = received,
+		};
+		if (!queue_push(&record)) {
+			queue.dropped++;
+		}
+		data += header_size + sizeof(xEvent);
+	}
+}
 
-			report_add_message(xev->u.keyButtonPointer.time, "Key %s released\n", XKeysymToString(XKeycodeToKeysym(dpy,
-					xev->u.u.detail, 0)));
-			if (response.timeout) {
-				application_set_user_action("key release (%s)",  XKeysymToString(XKeycodeToKeysym(dpy, xev->u.u.detail, 0)));
-				application_response_reset(xev->u.keyButtonPointer.time);
-			}
-			break;
 
-		case MotionNotify:
-			if (xrecord.motion) {
-				report_add_message(xev->u.keyButtonPointer.time, "Pointer moved to %dx%d\n",
-					xev->u.keyButtonPointer.rootX, xev->u.keyButtonPointer.rootY);
+/**
+ * The input capture thread.
+ *
+ * Receives the recorded data until the recording context is disabled
+ * and notifies the main thread about queued input records.
+ */
+static void* capture_thread(void* __attribute__((unused)) arg)
+{
+	xcb_record_enable_context_cookie_t cookie = xcb_record_enable_context(xrecord.connection, xrecord.context);
+	xcb_record_enable_context_reply_t* reply;
+
+	while ((reply = xcb_record_enable_context_reply(xrecord.connection, cookie, NULL))) {
+		int category = reply->category;
+		if (category == XRecordFromServer) {
+			capture_events(reply);
+			/* the pipe is full only when the main thread has notifications to process */
+			if (write(notify_fd, "", 1) < 0 && errno != EAGAIN) {
+				perror("Failed to notify about input events");
 			}
-			x = xev->u.keyButtonPointer.rootX;
-			y = xev->u.keyButtonPointer.rootY;
-			break;
-
-		default:
-			fprintf(stderr, "Unknown device event type %d\n", type);
-			break;
 		}
-
+		free(reply);
+		if (category == XRecordEndOfData) break;
 	}
-
-	XRecordFreeData(data);
+	return NULL;
 }
 
-/*
- * Public API implementation.
- */
-
 
-void xinput_init(Display* dpy)
+/**
+ * Initializes XRecord based input monitoring.
+ *
+ * @param[in] dpy   the display.
+ * @return          true if the input recording was started.
+ */
+static bool record_init(Display* dpy)
 {
-	if (xrecord.enabled) return;
-
 	int major = 0, minor = 0;
 	if (!XRecordQueryVersion(dpy, &major, &minor)) {
 		fprintf(stderr, "Can't monitor user input without xrecord extension\n");
-		exit(-1);
+		return false;
 	}
 
 	XRecordClientSpec clients = XRecordAllClients;
@@ -262,10 +502,11 @@ void xinput_init(Display* dpy)
 	int iRange = 0;
 	XRecordRange** rec_range = 0;
 
-	xrecord.display = XOpenDisplay(getenv("DISPLAY"));
-	if (!xrecord.display) {
+	xrecord.connection = xcb_connect(NULL, NULL);
+	if (xcb_connection_has_error(xrecord.connection)) {
 		fprintf(stderr, "Failed to open event recording display connection\n");
-		exit(-1);
+		xcb_disconnect(xrecord.connection);
+		return false;
 	}
 	/* prepare event range data */
 	rec_range = (XRecordRange**) g_malloc(sizeof(XRecordRange*) * num_ranges);
@@ -289,9 +530,8 @@ void xinput_init(Display* dpy)
 
 	/* */
 	xrecord.context = XRecordCreateContext(dpy, XRecordFromServerTime, &clients, 1, rec_range, num_ranges);
-	XFlush(dpy);
-	XFlush(xrecord.display);
-	XRecordEnableContextAsync(xrecord.display, xrecord.context, xrecord_callback, (XPointer) dpy);
+	/* the context must exist before the capture thread enables it on the other connection */
+	XSync(dpy, False);
 
 	/* release range data */
 	for (iRange = 0; iRange < num_ranges; iRange++) {
@@ -299,19 +539,323 @@ void xinput_init(Display* dpy)
 	}
 	free(rec_range);
 
+	int fds[2];
+	if (pipe(fds) < 0) {
+		perror("Failed to create input capture notification pipe");
+		XRecordFreeContext(dpy, xrecord.context);
+		xcb_disconnect(xrecord.connection);
+		return false;
+	}
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, O_NONBLOCK);
+	xrecord.fd = fds[0];
+	notify_fd = fds[1];
+
+	if (pthread_create(&capture_thread_id, NULL, capture_thread, NULL)) {
+		fprintf(stderr, "Failed to start input capture thread\n");
+		close(fds[0]);
+		close(fds[1]);
+		XRecordFreeContext(dpy, xrecord.context);
+		xcb_disconnect(xrecord.connection);
+		return false;
+	}
+	return true;
+}
+
+
+/**
+ * Releases XRecord based input monitoring resources.
+ */
+static void record_fini()
+{
+	/* disabling the context ends the recording in the capture thread */
+	XRecordDisableContext(display, xrecord.context);
+	XFlush(display);
+	pthread_join(capture_thread_id, NULL);
+
+	XRecordFreeContext(display, xrecord.context);
+	XFlush(display);
+	xcb_disconnect(xrecord.connection);
+	close(xrecord.fd);
+	close(notify_fd);
+
+	if (queue.dropped) {
+		fprintf(stderr, "Warning, %u input events were dropped because of full input queue\n", queue.dropped);
+	}
+}
+
+
+/**
+ * Retrieves the x and y axes of XInput2 slave pointer devices.
+ *
+ * @param[in] dpy   the display.
+ */
+static void xi2_query_devices(Display* dpy)
+{
+	int n_devices, i, j;
+	XIDeviceInfo* devices = XIQueryDevice(dpy, XIAllDevices, &n_devices);
+
+	pointer_devices = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+	for (i = 0; i < n_devices; i++) {
+		if (devices[i].use != XISlavePointer) continue;
+
+		pointer_axis_t* axes = g_new0(pointer_axis_t, 2);
+		for (j = 0; j < devices[i].num_classes; j++) {
+			XIValuatorClassInfo* valuator = (XIValuatorClassInfo*)devices[i].classes[j];
+			if (valuator->type != XIValuatorClass || valuator->number > 1) continue;
+
+			axes[valuator->number].absolute = valuator->mode == XIModeAbsolute;
+			axes[valuator->number].min = valuator->min;
+			axes[valuator->number].max = valuator->max;
+		}
+		g_hash_table_insert(pointer_devices, GINT_TO_POINTER(devices[i].deviceid), axes);
+	}
+	if (devices) XIFreeDeviceInfo(devices);
+}
+
+
+/**
+ * Updates the tracked pointer position from XInput2 raw event.
+ *
+ * The absolute axis values are mapped from the device range to the screen,
+ * the relative (accelerated) axis values are added to the position. Devices
+ * attached after the input monitoring was started are handled as relative.
+ * @param[in] raw   the raw event.
+ */
+static void xi2_update_pointer(XIRawEvent* raw)
+{
+	static const pointer_axis_t relative[2];
+	const pointer_axis_t* axes = g_hash_table_lookup(pointer_devices, GINT_TO_POINTER(raw->sourceid));
+	double* position[] = {&pointer_x, &pointer_y};
+	int size[] = {DisplayWidth(display, DefaultScreen(display)), DisplayHeight(display, DefaultScreen(display))};
+	/* the values are stored only for the axes set in the mask */
+	const double* value = raw->valuators.values;
+	int axis;
+
+	if (!axes) axes = relative;
+	for (axis = 0; axis < 2 && axis < raw->valuators.mask_len * 8; axis++) {
+		if (!XIMaskIsSet(raw->valuators.mask, axis)) continue;
+
+		if (axes[axis].absolute) {
+			*position[axis] = axes[axis].min < axes[axis].max ?
+					(*value - axes[axis].min) * (size[axis] - 1) / (axes[axis].max - axes[axis].min) : *value;
+		}
+		else {
+			*position[axis] += *value;
+		}
+		*position[axis] = CLAMP(*position[axis], 0, size[axis] - 1);
+		value++;
+	}
+}
+
+
+/**
+ * Initializes XInput2 raw event based input monitoring.
+ *
+ * Raw events are delivered to the root window regardless of grabs and
+ * of other clients selecting the same events since XInput 2.1.
+ * @param[in] dpy   the display.
+ * @return          true if the raw events were selected.
+ */
+static bool xi2_init(Display* dpy)
+{
+	int event, error;
+	int major = 2, minor = 2;
+
+	if (!XQueryExtension(dpy, "XInputExtension", &xrecord.xi_opcode, &event, &error) ||
+			XIQueryVersion(dpy, &major, &minor) != Success || major * 10 + minor < 21) {
+		fprintf(stderr, "Can't monitor user input without XInput 2.1 extension\n");
+		return false;
+	}
+
+	unsigned char mask_data[XIMaskLen(XI_LASTEVENT)] = {0};
+	XIEventMask mask = {
+			.deviceid = XIAllMasterDevices,
+			.mask_len = sizeof(mask_data),
+			.mask = mask_data,
+	};
+	XISetMask(mask_data, XI_RawKeyPress);
+	XISetMask(mask_data, XI_RawKeyRelease);
+	XISetMask(mask_data, XI_RawButtonPress);
+	XISetMask(mask_data, XI_RawButtonRelease);
+	XISetMask(mask_data, XI_RawMotion);
+	XISelectEvents(dpy, DefaultRootWindow(dpy), &mask, 1);
+
+	/* the raw events don't contain the pointer position, so it's queried
+	 * once and then tracked from the raw events */
+	Window root, child;
+	int x, y, win_x, win_y;
+	unsigned int state;
+	XQueryPointer(dpy, DefaultRootWindow(dpy), &root, &child, &x, &y, &win_x, &win_y, &state);
+	pointer_x = x;
+	pointer_y = y;
+	xi2_query_devices(dpy);
+
+	/* the raw events are received on the main connection */
+	xrecord.fd = -1;
+	return true;
+}
+
+
+/**
+ * Releases XInput2 raw event based input monitoring resources.
+ */
+static void xi2_fini()
+{
+	unsigned char mask_data[XIMaskLen(XI_LASTEVENT)] = {0};
+	XIEventMask mask = {
+			.deviceid = XIAllMasterDevices,
+			.mask_len = sizeof(mask_data),
+			.mask = mask_data,
+	};
+	XISelectEvents(display, DefaultRootWindow(display), &mask, 1);
+	XFlush(display);
+
+	g_hash_table_destroy(pointer_devices);
+	pointer_devices = NULL;
+}
+
+
+/*
+ * Public API implementation.
+ */
+
+
+bool xinput_init(Display* dpy)
+{
+	bool rc;
+
+	if (xrecord.enabled) return true;
+
+	/* the statistics and motion segment left by the previous session in daemon mode */
+	memset(&stats, 0, sizeof(stats));
+	memset(&motion, 0, sizeof(motion));
+
+	/* the windows at the pointer position are found in the mirrored stacking order */
+	stacking_init(dpy);
+
+	const char* backend = getenv(ENV_INPUT_BACKEND);
+	if (backend && !strcmp(backend, "xi2")) {
+		xrecord.backend = XINPUT_BACKEND_XI2;
+		rc = xi2_init(dpy);
+	}
+	else {
+		xrecord.backend = XINPUT_BACKEND_RECORD;
+		rc = record_init(dpy);
+	}
+	if (!rc) {
+		if (motion_log) {
+			fclose(motion_log);
+			motion_log = NULL;
+		}
+		return false;
+	}
+
 	xrecord.enabled = true;
 
-	wmstate_atom = XInternAtom(dpy, "WM_STATE", False);
 	display = dpy;
+	return true;
 }
 
 
 void xinput_fini()
 {
 	if (xrecord.enabled) {
-		XRecordDisableContext(display, xrecord.context);
-		XRecordFreeContext(display, xrecord.context);
-		XFlush(display);
-		XCloseDisplay(xrecord.display);
+		if (xrecord.backend == XINPUT_BACKEND_XI2) {
+			xi2_fini();
+		}
+		else {
+			record_fini();
+		}
+		xrecord.enabled = false;
+		xrecord.motion = false;
+
+		if (motion_log) {
+			fclose(motion_log);
+			motion_log = NULL;
+		}
+	}
+}
+
+
+void xinput_process()
+{
+	char buffer[64];
+	input_record_t record;
+
+	if (xrecord.fd >= 0) {
+		/* clear the notifications before processing, so new records will notify again */
+		while (read(xrecord.fd, buffer, sizeof(buffer)) > 0);
+
+		while (queue_pop(&record)) {
+			process_record(&record);
+		}
 	}
+
+	/* report the motion segment if the pointer has stopped */
+	if (motion.count) {
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		if ((now.tv_sec - motion.last.tv_sec) * 1000 + (now.tv_usec - motion.last.tv_usec) / 1000 > XINPUT_MOTION_GAP) {
+			motion_flush();
+		}
+	}
+}
+
+
+void xinput_process_event(XEvent* ev)
+{
+	static const int event_types[] = {
+			[XI_RawKeyPress] = KeyPress,
+			[XI_RawKeyRelease] = KeyRelease,
+			[XI_RawButtonPress] = ButtonPress,
+			[XI_RawButtonRelease] = ButtonRelease,
+			[XI_RawMotion] = MotionNotify,
+	};
+	XGenericEventCookie* cookie = &ev->xcookie;
+
+	if (!xrecord.enabled || xrecord.backend != XINPUT_BACKEND_XI2 || cookie->extension != xrecord.xi_opcode) return;
+	if (cookie->evtype < XI_RawKeyPress || cookie->evtype > XI_RawMotion) return;
+
+	uint64_t received = get_monotonic_time();
+	/* the XCB event backend provides already converted event data */
+	if (xhandler.backend == XHANDLER_BACKEND_XLIB && !XGetEventData(display, cookie)) return;
+
+	XIRawEvent* raw = cookie->data;
+	xi2_update_pointer(raw);
+	input_record_t record = {
+			.type = event_types[cookie->evtype],
+			.detail = raw->detail,
+			.time = raw->time,
+			.x = pointer_x,
+			.y = pointer_y,
+			.received = received,
+	};
+	if (xhandler.backend == XHANDLER_BACKEND_XLIB) XFreeEventData(display, cookie);
+
+	process_record(&record);
+}
+
+
+void xinput_report()
+{
+	if (!xrecord.enabled) return;
+
+	/* report the pointer motion segment in progress */
+	motion_flush();
+
+	if (!stats.count) return;
+	report_add_message_forced("Input events received with %s backend: %u events, "
+			"queued %.2f us/event, delivery delay %.2f ms (min %.2f ms, max %.2f ms)\n",
+			xrecord.backend == XINPUT_BACKEND_XI2 ? "XInput2" : "XRecord", stats.count,
+			(double)stats.queued / stats.count / 1000, (double)stats.delay_sum / stats.count / 1000,
+			(double)stats.delay_min / 1000, (double)stats.delay_max / 1000);
+}
+
+
+bool xinput_set_motion_log(const char* filename)
+{
+	if (motion_log) fclose(motion_log);
+	motion_log = fopen(filename, "wb");
+	return motion_log != NULL;
 }
@@ -60,19 +60,38 @@
 #include <X11/extensions/XTest.h>
 #include <X11/extensions/Xdamage.h>
 #include <X11/extensions/record.h>
+#include <X11/extensions/XInput2.h>
+
+#include <xcb/xcb.h>
+#include <xcb/record.h>
+
+/**
+ * User input monitoring backends.
+ */
+enum {
+	XINPUT_BACKEND_RECORD,  /* XRecord extension, captured by a dedicated thread */
+	XINPUT_BACKEND_XI2,     /* XInput2 raw events, received on the main connection */
+};
 
 /**
  * User input monitoring data.
  */
 typedef struct {
-	/* the recording display */
-	Display* display;
+	/* the user input monitoring backend (XINPUT_BACKEND_*) */
+	int backend;
+	/* the XInput extension major opcode, used by XI2 backend */
+	int xi_opcode;
+	/* the recording connection, used only by the input capture thread */
+	xcb_connection_t* connection;
 	/* the recording context */
 	XRecordContext context;
+	/* the input capture notification file descriptor, readable when
+	 * captured input records are queued, -1 with XI2 backend */
+	int fd;
 	/* true if user input monitoring enabled and
 	 * XRecord support initialized */
 	bool enabled;
-	/* true if pointer motion must be reported */
+	/* true if pointer motion segments must be reported */
 	bool motion;
 } xrecord_t;
 
@@ -83,9 +102,18 @@ extern xrecord_t xrecord;
 /**
  * Initializes input subsystem.
  *
+ * The input events are recorded by a dedicated capture thread on its own
+ * connection and passed to the main thread with a lock free queue, so
+ * input capture is not delayed by damage event processing.
+ *
+ * Alternatively XInput2 raw events can be selected on the root window by
+ * setting XRESPONSE_INPUT_BACKEND environment variable to 'xi2'. The raw
+ * events are received with the other events on the main connection and
+ * must be passed to xinput_process_event().
  * @param[in] dpy  the connected display
+ * @return         true if the input monitoring was started.
  */
-void xinput_init(Display* dpy);
+bool xinput_init(Display* dpy);
 
 /**
  * Releases resources allocated by input subsystem.
@@ -95,4 +123,42 @@ void xinput_init(Display* dpy);
 void xinput_fini();
 
 
+/**
+ * Processes the input records queued by the capture thread.
+ *
+ * Must be called when xrecord.fd becomes readable and periodically
+ * to report finished pointer motion segments.
+ */
+void xinput_process();
+
+
+/**
+ * Processes XInput2 raw input event.
+ *
+ * @param[in] ev   the generic event.
+ */
+void xinput_process_event(XEvent* ev);
+
+
+/**
+ * Reports the input event delivery statistics of the active backend.
+ *
+ * The statistics include the queuing delay between receiving and processing
+ * the events and the delivery delay between the server event timestamps and
+ * receiving the events, allowing to compare the input monitoring backends.
+ */
+void xinput_report();
+
+
+/**
+ * Starts logging every pointer motion event into binary file.
+ *
+ * The log consists of 8 byte records in host byte order - 32 bit
+ * timestamp followed by 16 bit x and y coordinates.
+ * @param[in] filename   the log file name.
+ * @return               true if the log file was opened.
+ */
+bool xinput_set_motion_log(const char* filename);
+
+
 #endif
@@ -48,6 +48,7 @@
 #include <X11/keysym.h>
 #include <X11/XKBlib.h>
 #include <X11/Xutil.h>
+#include <X11/Xatom.h>
 #include <X11/Xproto.h>
 #include <X11/extensions/XTest.h>
 #include <X11/extensions/Xdamage.h>
@@ -61,6 +62,20 @@
 #include "xhandler.h"
 #include "xinput.h"
 #include "report.h"
+#include "idle.h"
+#include "heatmap.h"
+#include "timeline.h"
+#include "content.h"
+#include "reference.h"
+#include "visual.h"
+#include "recorder.h"
+#include "present.h"
+#include "compositor.h"
+#include "area.h"
+#include "filter.h"
+#include "wincache.h"
+#include "stacking.h"
+#include "control.h"
 
 
 /* 
@@ -82,27 +97,24 @@
 #define ASIZE(a)	(sizeof(a) / sizeof(a[0]))
 
 
-/* region filtering rules */
-enum {
-	EXCLUDE_NONE, /* region filtering is not set */
-	EXCLUDE_LESS, /* exclude regions that are less or equal than specified region/size */
-	EXCLUDE_GREATER
-/* exclude regions that are greater than specified region/size */
-};
-
-
 /* options data */
 options_t options = {
 	.damage_wait_secs = -1,
 	.break_on_damage = 0,
 	.abort_wait = 0,
 
-	.exclude_size = 0,
-	.exclude_rules = EXCLUDE_NONE,
-
 	.break_timeout = 0,
 };
 
+/* true if the measurement sessions are received from control socket */
+static bool daemon_mode = false;
+
+/* the number of interrupt signals received since the daemon started waiting for a session */
+static volatile sig_atomic_t interrupts = 0;
+
+/* true if the keysym mapping has been loaded */
+static bool keymap_loaded = false;
+
 
 bool check_timeval_timeout(struct timeval* tv1, struct timeval* tv2, int timeout)
 {
@@ -116,32 +128,104 @@ bool check_timeval_timeout(struct timeval* tv1, struct timeval* tv2, int timeout
 
 
 /**
- * Checks if the damaged area from damage event matches exclusion filter.
- * @param[in] dev  the damage event.
- * @return         true if the area matches exclusion filter and must be excluded from reports.
- *                 false otherwise.
+ * Processes damage event.
+ *
+ * @param[in] dev   the damage event.
+ */
+static void process_damage(XDamageNotifyEvent* dev)
+{
+	int xpos = dev->area.x + dev->geometry.x;
+	int ypos = dev->area.y + dev->geometry.y;
+	window_t* win = window_find(dev->drawable);
+	if (win) window_register_damage(win, dev->timestamp);
+
+	/* check if the damage are is in the monitoring areas */
+	area_mask_t areas = area_match(xpos, ypos, dev->area.width, dev->area.height);
+	if (areas) {
+		bool ignored;
+		if (!filter_exclude(dev, win, xpos, ypos, &ignored)) {
+			/* repaints of identical content are reported, but don't count as response */
+			bool noop = !content_changed(dev);
+			report_add_message(dev->timestamp, "Got %sdamage event %dx%d+%d+%d from 0x%lx (%s)\n", noop ? "no-op " : "",
+					dev->area.width, dev->area.height, xpos, ypos, dev->drawable,
+					win && win->application ? win->application->name : "unknown");
+
+			idle_register_damage(win, dev);
+			heatmap_add(xpos, ypos, dev->area.width, dev->area.height);
+			area_register_damage(areas, xpos, ypos, dev->area.width, dev->area.height, dev->timestamp,
+					noop ? 0 : response.last_action_time);
+			if (response.settle && !ignored && !noop) area_register_settle_damage(areas);
+			if (!noop) recorder_register_damage(xpos, ypos, dev->area.width, dev->area.height, dev->timestamp);
+
+			if (response.last_action_time && !noop) {
+				visual_register_damage(xpos, ypos, dev->area.width, dev->area.height);
+				/* the root window damage is the compositor output itself */
+				if (dev->drawable != DefaultRootWindow(xhandler.display)) {
+					compositor_register_damage(xpos, ypos, dev->area.width, dev->area.height, dev->timestamp);
+				}
+				if (win && win->application) {
+					application_register_damage(win->application, dev);
+				}
+			}
+
+			/* the matching reference image completes the measurement, but only after the
+			 * user action, so the screen matching before it doesn't end the measurement */
+			if ((response.last_action_time || !scheduler_used()) &&
+					reference_check(xpos, ypos, dev->area.width, dev->area.height, dev->timestamp, response.last_action_time)) {
+				if (response.last_action_time) application_response_report();
+				options.abort_wait = true;
+			}
+		}
+	}
+}
+
+
+/**
+ * Processes damage attributed to a top level window in root damage mode.
+ *
+ * @param[in] dev   the damage event.
  */
-static bool match_exclude_rules(XDamageNotifyEvent* dev)
+static void process_toplevel_damage(XDamageNotifyEvent* dev)
 {
-	/* no exclude filters set, match everything */
-	if (options.exclude_rules == EXCLUDE_NONE) return false;
-
-	/* exclude areas that are less than the specified values */
-	if (options.exclude_rules == EXCLUDE_LESS) {
-		/* if exclude size is specified, check area total size */
-		if (options.exclude_size) return (options.exclude_size >= dev->area.width * dev->area.height);
-		/* otherwise check area edge size */
-		return (dev->area.width <= options.exclude_rect.width || dev->area.height <= options.exclude_rect.height);
+	/* with reparenting window managers the monitored window is the client inside the frame */
+	window_t* win = window_find(dev->drawable);
+	if (!win) win = window_find_ancestor(wincache_find_client(dev->drawable));
+	if (win) {
+		dev->drawable = win->window;
+		process_damage(dev);
 	}
-	/* process EXCLUDE_GREATER rule */
+}
+
 
-	/* if exclude size is specified, check area total size */
-	if (options.exclude_size) return (options.exclude_size < dev->area.width * dev->area.height);
-	/* otherwise check area edge size */
-	return (dev->area.width > options.exclude_rect.width || dev->area.height > options.exclude_rect.height);
+/**
+ * Processes root window damage event in root damage mode.
+ *
+ * @param[in] dev   the damage event.
+ */
+static void process_root_damage(XDamageNotifyEvent* dev)
+{
+	/* the whole screen damage is reported if the root window is monitored */
+	if (window_find(dev->drawable)) process_damage(dev);
+	stacking_split_damage(dev, process_toplevel_damage);
 }
 
 
+/**
+ * Checks if the event is the second copy of a reparent notification.
+ *
+ * The structure notifications are received from the parents of windows, but
+ * reparent notifications are delivered to both the old and the new parent.
+ * The copy of the new parent is processed, unless the new parent is not cached
+ * and doesn't receive the notification.
+ * @param[in] ev   the event to check.
+ * @return         true if the event is a duplicate.
+ */
+static bool is_duplicate_event(XEvent* ev)
+{
+	return ev->type == ReparentNotify && ev->xreparent.event != ev->xreparent.parent &&
+			wincache_has_window(ev->xreparent.parent);
+}
+
 
 /**
  * Retrieves and processes single X event.
@@ -152,45 +236,49 @@ static int process_event(int slice)
 	struct timeval tv = { 0, slice * 1000 };
 
 	if (!options.abort_wait && xhandler_get_xevent_timed(&e.ev, &tv)) {
-		if (e.ev.type == xhandler.damage_event_num + XDamageNotify) {
-			XDamageNotifyEvent *dev = &e.dev;
-			int xpos = dev->area.x + dev->geometry.x;
-			int ypos = dev->area.y + dev->geometry.y;
-			/* check if the damage are is in the monitoring area */
-			if (xpos + dev->area.width >= options.interested_damage_rect.x && xpos <= (options.interested_damage_rect.x
-					+ options.interested_damage_rect.width) && ypos + dev->area.height >= options.interested_damage_rect.y &&
-					ypos <= (options.interested_damage_rect.y + options.interested_damage_rect.height)) {
-				if (!match_exclude_rules(dev)) {
-					window_t* win = window_find(dev->drawable);
-					report_add_message(dev->timestamp, "Got damage event %dx%d+%d+%d from 0x%lx (%s)\n", dev->area.width,
-							dev->area.height, xpos, ypos, dev->drawable,
-							win && win->application ? win->application->name : "unknown");
-
-					if (response.last_action_time) {
-						window_t* win = window_find(dev->drawable);
-						if (win && win->application) {
-							application_register_damage(win->application, dev);
-						}
-					}
-				}
+		if (is_duplicate_event(&e.ev)) return e.ev.type;
+
+		wincache_process_event(&e.ev);
+		stacking_process_event(&e.ev);
+
+		if (e.ev.type == GenericEvent) {
+			xinput_process_event(&e.ev);
+			present_process_event(&e.ev);
+		} else if (e.ev.type == xhandler.damage_event_num + XDamageNotify) {
+			if (compositor_is_damage(e.dev.damage)) {
+				compositor_process_damage(&e.dev);
+			}
+			else if (window_is_root_damage(e.dev.damage)) {
+				process_root_damage(&e.dev);
 			}
-			XDamageSubtract(xhandler.display, dev->damage, None, None);
+			/* damage of windows waiting for admission is processed after admission */
+			else if (!window_buffer_damage(&e.dev)) {
+				process_damage(&e.dev);
+			}
+			xhandler_damage_subtract(e.dev.damage);
 		} else if (e.ev.type == CreateNotify) {
 			/* check new windows if we have to monitor them */
 			XCreateWindowEvent* ev = &e.cev;
-			/* TODO: Check if we really must monitor only main windows.
-			 Probably done to avoid double reporting. We could avoid that by
-			 going through monitored window list, checking if this window
-			 is in the parent chain of any monitored window. If so, remove the child.
-			 Might be expensive though, but worth a try.
+			/* Damage of child windows is reported by the monitored ancestor damage
+			 * object, so only windows without monitored ancestors are queued
+			 * to avoid double reporting.
 			 */
-			if (ev->parent == DefaultRootWindow(xhandler.display)) {
-				window_t* win = window_try_monitor(ev->window);
+			if (!window_find_ancestor(ev->parent)) {
+				/* the window is admitted asynchronously by window_process_pending() */
+				window_queue(ev->window, false);
+			}
+		} else if (e.ev.type == ReparentNotify) {
+			XReparentEvent* ev = &e.rev;
+			window_t* win = window_find(ev->window);
+			if (window_find_ancestor(ev->parent)) {
+				/* the window was embedded into a monitored window */
 				if (win) {
-					Time start = xhandler_get_server_time();
-					report_add_message(start, "Created window 0x%lx (%s)\n", ev->window,
-							win->application ? win->application->name : "unknown");
+					report_add_message(REPORT_LAST_TIMESTAMP, "Reparented window 0x%lx (%s) into monitored window 0x%lx\n",
+							ev->window, win->application ? win->application->name : "unknown", ev->parent);
+					window_remove(win);
 				}
+			} else if (!win) {
+				window_queue(ev->window, true);
 			}
 		} else if (e.ev.type == UnmapNotify) {
 			XUnmapEvent* ev = &e.uev;
@@ -202,6 +290,7 @@ static int process_event(int slice)
 			}
 		} else if (e.ev.type == MapNotify) {
 			XMapEvent* ev = &e.mev;
+			window_requeue(ev->window, true);
 			window_t* win = window_find(ev->window);
 			if (win) {
 				Time start = xhandler_get_server_time();
@@ -210,6 +299,8 @@ static int process_event(int slice)
 			}
 		} else if (e.ev.type == DestroyNotify) {
 			XDestroyWindowEvent* ev = (XDestroyWindowEvent*) &e.dstev;
+			window_unqueue(ev->window);
+			content_remove_window(ev->window);
 			window_t* win = window_find(ev->window);
 			if (win) {
 				Time start = xhandler_get_server_time();
@@ -217,6 +308,16 @@ static int process_event(int slice)
 						win->application ? win->application->name : "unknown");
 				window_remove(win);
 			}
+		} else if (e.ev.type == PropertyNotify) {
+			/* query the resource name of windows waiting for admission when it's set */
+			if (e.ev.xproperty.atom == XA_WM_CLASS) {
+				Window window = e.ev.xproperty.window;
+				if (window_is_queued(window)) {
+					window_requeue(window, false);
+				} else if (!window_find_ancestor(window)) {
+					window_queue(window, true);
+				}
+			}
 		} else {
 			/* remove to avoid reporting unwanted even types ?
 			 with window creation monitoring there are more unhandled event types */
@@ -246,11 +347,26 @@ static int wait_response()
 		if (options.break_timeout && check_timeval_timeout(&last_time, &current_time, options.break_timeout))
 			break;
 
+		/* admit new windows whose resource names have been received */
+		window_process_pending(process_damage);
+
 		/* simulate events */
 		int next_delay = scheduler_process(&current_time);
 		if (!next_delay || next_delay > WAIT_RESOLUTION) next_delay = WAIT_RESOLUTION;
 
 		event_type = process_event(next_delay);
+		visual_update(&current_time);
+		recorder_update(&current_time);
+
+		/* With settle detection the response checking can end while ignored damage
+		 * is received, otherwise it's checked only when there are no events */
+		if (response.last_action_time && (!event_type || response.settle) &&
+				application_response_settled(&current_time)) {
+			application_response_report();
+			/* stop waiting when the last scripted user action has settled */
+			if (response.settle && scheduler_done()) break;
+		}
+
 		if (event_type == xhandler.damage_event_num + XDamageNotify) {
 			last_time = current_time;
 
@@ -258,11 +374,6 @@ static int wait_response()
 			if (options.break_on_damage && !(--options.break_on_damage))
 				break;
 		} else if (!event_type) {
-			if (response.last_action_time) {
-				if (check_timeval_timeout(&response.last_action_timestamp, &current_time, response.timeout)) {
-					application_response_report();
-				}
-			}
 			report_flush_queue();
 			report_time = current_time;
 		}
@@ -292,7 +403,9 @@ void usage(char *progname)
 		"-k|--key <keysym[,delay]>           Simulate pressing and releasing a key\n"
 		"                                    Delay is in milliseconds.\n"
 		"                                If not specified, default of %lu ms is used\n"
-		"-m|--monitor <WIDTHxHEIGHT+X+Y>     Watch area for damage ( default fullscreen )\n"
+		"-m|--monitor <[name=]WxH+X+Y[,quiet]> Watch area for damage ( default fullscreen ).\n"
+		"                                    Can be specified multiple times to watch several areas.\n"
+		"                                    The optional quiet period overrides --settle for the area.\n"
 		"-w|--wait <seconds>                 Max time to wait for damage, set to 0 to\n"
 		"                                    monitor for ever.\n"
 		"                                    ( default 5 secs)\n"
@@ -307,15 +420,58 @@ void usage(char *progname)
 		"                                    Specify either region dimensions XxY or size S.\n"
 		"                                    less - exclude regions less or equal than specified (default).\n"
 		"                                    greater - exclude regions graeter than specified.\n"
+		"-x|--exclude <cond[,cond...]>       Exclude damage matching all conditions <key><op><value>, where\n"
+		"                                    key is width, height, area, aspect, x, y, window, rate or app,\n"
+		"                                    op is <, <=, >, >=, = or !=. in=WxH+X+Y matches damage inside\n"
+		"                                    the rectangle. Can be specified multiple times.\n"
+		"-X|--include <cond[,cond...]>       Report only damage matching at least one include rule.\n"
 		"-b|--break <msec>|damage[,<number>] Break the wait if no damage was registered in <msec> period,\n"
 		"                                    or after the <number> damage event if 'damage' was specified.\n"
 		"-l|--level <raw|delta|box|nonempty> Specify the damage reporting level.\n"
 		"-u|--user                           Enable user input monitoring.\n"
+		"                                    Set XRESPONSE_INPUT_BACKEND=xi2 to use XInput2 raw events instead of XRecord.\n"
 		"-U|--user-all                       Enable all user input monitoring, including pointer movement.\n"
+		"                                    Pointer motion is reported in segments ended by button/key events or pauses.\n"
+		"-M|--motion-log <file>              Write every pointer motion event to binary <file>.\n"
 "-r|--response <timeout[,verbose]>   Enable application response monitoring (timeout given in msecs).\n"
 		"                                    If verbose is not specified the damage reporting will be suppresed.\n"
-		"\n", progname, progname, DEFAULT_KEY_DELAY);
-	exit(1);
+		"-S|--settle <msec>                  End response checking when the monitored areas get no damage for <msec>,\n"
+		"                                    the response timeout is used as the hard cap. Stops waiting when the\n"
+		"                                    last scripted user action has settled.\n"
+		"-Q|--settle-ignore <cond[,cond...]> Ignore damage matching the conditions (see --exclude) when settling.\n"
+		"-I|--idle <seconds>                 Collect per application damage statistics and report applications\n"
+		"                                    repainting after no user input was received for <seconds>.\n"
+		"-R|--root-damage                    Use a single damage object on the root window and attribute the damage\n"
+		"                                    to windows by their stacking order and geometry.\n"
+		"-H|--heatmap <file[,cellsize]>      Accumulate damaged areas into a grid of <cellsize> pixel cells\n"
+		"                                    and write it as PGM image <file> at exit (default cell size %d).\n"
+		"-V|--verify                         Fetch the damaged content and mark damage not changing it as no-op,\n"
+		"                                    excluding it from response times. Can't be used with --root-damage.\n"
+		"-D|--framebuffer <file>             Read the screen content for --verify, --until-image, --speed-index and\n"
+		"                                    --flight-recorder directly from Xvfb framebuffer <file> (Xvfb_screen0\n"
+		"                                    in the Xvfb -fbdir directory) instead of fetching it with MIT-SHM.\n"
+		"-E|--until-image <area,file[,tol]>  Stop waiting when the screen <area> (WxH+X+Y or a --monitor area\n"
+		"                                    name) matches binary PPM image <file> within mean channel difference\n"
+		"                                    <tol> (default 0). Use --root-damage with compositing managers.\n"
+		"-F|--speed-index <fps[,area]>       Sample the screen <area> (WxH+X+Y or a --monitor area name, default\n"
+		"                                    fullscreen) at most <fps> times per second after user action and\n"
+		"                                    report its speed index and visual completeness times. Requires --response.\n"
+		"-B|--flight-recorder <budget,dir[,frames[,area]]>\n"
+		"                                    Keep the last <frames> snapshots (default %d) of the screen <area> and\n"
+		"                                    write them as PPM images into <dir> when the response to user action\n"
+		"                                    exceeds <budget> msecs. Requires --response.\n"
+		"-P|--present                        Report when the frames of monitored windows were presented, using\n"
+		"                                    Present extension complete notifications. Requires --response.\n"
+		"-C|--compositor                     Track the compositing manager output and report the delay between\n"
+		"                                    client damage and the compositor frame covering it. Requires --response,\n"
+		"                                    can't be used with --root-damage.\n"
+		"-T|--timeline <file>                Write the response timeline of every user action into tab separated\n"
+		"                                    <file> and summarize the timelines at exit. Requires --response.\n"
+		"-L|--daemon <socket>                Keep running and receive measurement sessions from Unix domain\n"
+		"                                    socket <socket>. Must be the only option. A client writes one line\n"
+		"                                    with the above options and the session report is streamed back.\n"
+		"\n", progname, progname, DEFAULT_KEY_DELAY, HEATMAP_DEFAULT_CELL_SIZE,
+		RECORDER_DEFAULT_FRAMES);
 }
 
 
@@ -336,44 +492,85 @@ static bool match_regex(const char* options, const char* pattern)
 static void abort_wait()
 {
 	options.abort_wait = true;
+	interrupts++;
 }
 
 /* Code copy from xautomation / vte.c ends */
 
-int main(int argc, char **argv)
+/**
+ * Releases the resources allocated by measurement session.
+ */
+static void session_fini()
+{
+	scheduler_fini();
+
+	report_flush_queue();
+	report_fini();
+	xinput_fini();
+
+	idle_fini();
+	heatmap_fini();
+	timeline_fini();
+	reference_fini();
+	visual_fini();
+	recorder_fini();
+	content_fini();
+	area_fini();
+	filter_fini();
+	window_reset();
+	present_fini();
+	compositor_fini();
+	stacking_fini();
+	application_reset();
+}
+
+
+/**
+ * Runs measurement session specified by the command line options.
+ *
+ * @param[in] argc   the number of arguments.
+ * @param[in] argv   the arguments, starting with the program name.
+ * @return           the exit code.
+ */
+static int run_session(int argc, char **argv)
 {
 	int cnt, x, y, i = 0, verbose = 0;
 	Window win = 0;
-	Bool keysymMappingInitialized = False;
 	int rc = 0;
 	int inputEvents[100];
 	int inputEventsIndex = 0;
 	int iEvent = 0;
+	bool root_damage = false;
+	bool compositor_delay = false;
+	bool verify = false;
 
-	if (argc == 1)
+	if (argc == 1) {
 		usage(argv[0]);
+		return 1;
+	}
 
 	const char* log_file = NULL;
 	if (streq(argv[1],"-o") || streq(argv[1],"--logfile")) {
 		i++;
 
-		if (++i > argc)
+		if (++i > argc) {
 			usage(argv[0]);
+			return 1;
+		}
 
 		log_file = argv[i];
 	}
-	report_init(log_file);
+	if (!report_init(log_file))
+		return -1;
 
-	if (!xhandler_init(getenv("DISPLAY")))
-		exit(1);
-
-	report_add_message(xhandler_get_server_time(), "Startup\n");
+	report_add_message(xhandler_get_server_time(), daemon_mode ? "Session start\n" : "Startup\n");
 
 	/* initialize subsystems */
-	xemu_init(xhandler.display);
 	scheduler_init(xhandler.display);
-	window_init(xhandler.display);
-	application_init();
+
+	/* scan the window tree while processing the command line options, in daemon
+	 * mode the window tree mirror is scanned by application_start_monitor() */
+	if (!daemon_mode) window_scan_begin(DefaultRootWindow(xhandler.display));
 
 	/*
 	 * Process the command line options.
@@ -390,7 +587,7 @@ int main(int argc, char **argv)
 		if (streq(argv[i], "-id") || streq(argv[i], "--id")) {
 			char name[PATH_MAX];
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 
 			cnt = sscanf(argv[i], "0x%lx", &win);
 			if (cnt < 1) {
@@ -398,12 +595,16 @@ int main(int argc, char **argv)
 			}
 			if (cnt < 1) {
 				fprintf(stderr, "*** invalid window id '%s'\n", argv[i]);
-				usage(argv[0]);
+				goto usage_error;
 			}
 			sprintf(name, "0x%lx", win);
+			/* the window can be kept by the previous session in daemon mode */
+			window_t* kept = window_find(win);
+			if (kept) window_remove(kept);
 			if (!window_add(win, application_monitor(name))) {
 				fprintf(stderr, "Could not setup damage monitoring for window 0x%lx!\n", win);
-				exit(1);
+				rc = 1;
+				goto out;
 			}
 			if (verbose)
 				report_add_message(REPORT_LAST_TIMESTAMP, "Monitoring window 0x%lx\n", win);
@@ -413,7 +614,7 @@ int main(int argc, char **argv)
 
 		if (streq(argv[i], "-a") || streq(argv[i], "--application")) {
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 
 			response.application = application_monitor(argv[i]);
 			if (response.application && verbose) {
@@ -428,26 +629,26 @@ int main(int argc, char **argv)
 		if (streq("-c", argv[i]) || streq("--click", argv[i])) {
 			if (!xemu.pointer.dev) {
 				fprintf(stderr, "Failed to open pointer device, unable to simulate pointer events.\n");
-				exit(-1);
+				goto error;
 			}
 			if (inputEventsIndex == ASIZE(inputEvents)) {
 				fprintf(stderr, "Too many input events specified\n");
-				exit(-1);
+				goto error;
 			}
 			if (!argv[i + 1] || !match_regex(argv[i + 1], "^[0-9]+x[0-9]+(,[0-9]+)?$")) {
 				fprintf(stderr, "Failed to parse --c options: %s\n", argv[i + 1]);
-				exit(-1);
+				goto error;
 			}
 			inputEvents[inputEventsIndex++] = i;
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 
 			continue;
 		}
 
 		if (streq("-l", argv[i]) || streq("--level", argv[i])) {
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 
 			if (!strcmp(argv[i], "raw")) {
 				window_set_damage_level(XDamageReportRawRectangles);
@@ -459,77 +660,71 @@ int main(int argc, char **argv)
 				window_set_damage_level(XDamageReportNonEmpty);
 			} else {
 				fprintf(stderr, "Unrecongnized damage level: %s\n", argv[i]);
-				usage(argv[0]);
+				goto usage_error;
 			}
 			if (verbose)
 				report_add_message(REPORT_LAST_TIMESTAMP, "Setting damage report level to %s\n", argv[i]);
 			continue;
 		}
 
-		if (streq("-x", argv[i]) || streq("--exclude", argv[i])) {
-			char* exclude[] = { "none", "less", "greater" };
-
-			if (options.exclude_rules != EXCLUDE_NONE) {
-				fprintf(stderr, "Duplicated --exclude parameter detected. Aborting\n");
-				exit(-1);
-			}
+		if (streq("-x", argv[i]) || streq("--exclude", argv[i]) ||
+				streq("-X", argv[i]) || streq("--include", argv[i])) {
+			bool include = streq("-X", argv[i]) || streq("--include", argv[i]);
 
 			if (++i >= argc)
-				usage(argv[0]);
-			char rules[32] = "";
-			if ((cnt = sscanf(argv[i], "%ux%u,%s", &options.exclude_rect.width, &options.exclude_rect.height, rules)) >= 2) {
-				options.exclude_size = 0;
-			} else if ((cnt = sscanf(argv[i], "%u,%s", &options.exclude_size, rules)) >= 1) {
-				options.exclude_rect.width = 0;
-				options.exclude_rect.height = 0;
-			} else {
+				goto usage_error;
+			if (!filter_add(argv[i], include ? FILTER_RULE_INCLUDE : FILTER_RULE_EXCLUDE)) {
 				fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
-				usage(argv[0]);
-			}
-			options.exclude_rules = *rules && !strcmp(rules, "greater") ? EXCLUDE_GREATER : EXCLUDE_LESS;
-			if (verbose) {
-				if (options.exclude_size) {
-					report_add_message(REPORT_LAST_TIMESTAMP, "Excluding damage areas %s than %d pixels\n", exclude[options.exclude_rules],
-							options.exclude_size);
-				} else {
-					report_add_message(REPORT_LAST_TIMESTAMP, "Excluding damage areas %s than (%dx%d)\n", exclude[options.exclude_rules],
-							options.exclude_rect.width, options.exclude_rect.height);
-				}
+				goto usage_error;
 			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "%s damage areas matching %s\n",
+						include ? "Including" : "Excluding", argv[i]);
 			continue;
 		}
 
 		if (streq("-m", argv[i]) || streq("--monitor", argv[i])) {
-			if (options.interested_damage_rect.width || options.interested_damage_rect.height || options.interested_damage_rect.x
-					|| options.interested_damage_rect.y) {
-				fprintf(stderr, "Duplicated --monitor parameter detected. Aborting\n");
-				exit(-1);
-			}
 			if (++i >= argc)
-				usage(argv[0]);
-
-			if ((cnt = sscanf(argv[i], "%ux%u+%u+%u", &options.interested_damage_rect.width, &options.interested_damage_rect.height,
-					&options.interested_damage_rect.x, &options.interested_damage_rect.y)) != 4) {
+				goto usage_error;
+
+			Rectangle rect;
+			unsigned int quiet = 0;
+			char name[64] = "";
+			const char* geometry = strchr(argv[i], '=');
+			if (geometry) {
+				snprintf(name, sizeof(name), "%.*s", (int)(geometry - argv[i]), argv[i]);
+				geometry++;
+			}
+			else {
+				geometry = argv[i];
+			}
+			if ((cnt = sscanf(geometry, "%ux%u+%u+%u,%u", &rect.width, &rect.height, &rect.x, &rect.y, &quiet)) < 4) {
 				fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
-				usage(argv[0]);
+				goto usage_error;
 			}
+			area_t* area = area_add(name, &rect);
+			if (!area) {
+				fprintf(stderr, "Too many monitor areas specified (max %d). Aborting\n", AREA_MAX);
+				goto error;
+			}
+			area->quiet = quiet;
 			if (verbose) {
-				report_add_message(REPORT_LAST_TIMESTAMP, "Set monitor rect to %ix%i+%i+%i\n", options.interested_damage_rect.width,
-						options.interested_damage_rect.height, options.interested_damage_rect.x, options.interested_damage_rect.y);
+				report_add_message(REPORT_LAST_TIMESTAMP, "Added monitor rect %s%s%ix%i+%i+%i\n", name, *name ? " " : "",
+						rect.width, rect.height, rect.x, rect.y);
 			}
 			continue;
 		}
 
 		if (streq("-w", argv[i]) || streq("--wait", argv[i])) {
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 
 			if (options.damage_wait_secs >= 0) {
 				fprintf(stderr, "Duplicate -w(--wait) option detected. Discarding the previous value\n");
 			}
 			if ((options.damage_wait_secs = atoi(argv[i])) < 0) {
 				fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
-				usage(argv[0]);
+				goto usage_error;
 			}
 			if (verbose)
 				report_add_message(REPORT_LAST_TIMESTAMP, "Set event timeout to %isecs\n", options.damage_wait_secs);
@@ -544,7 +739,7 @@ int main(int argc, char **argv)
 				options.break_on_damage = 0;
 			}
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 
 			if (!strncmp(argv[i], "damage", 6)) {
 				sscanf(argv[i] + 6, ",%d", &options.break_on_damage);
@@ -555,7 +750,7 @@ int main(int argc, char **argv)
 			} else {
 				if ((options.break_timeout = atoi(argv[i])) < 0) {
 					fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
-					usage(argv[0]);
+					goto usage_error;
 				}
 				if (verbose)
 					report_add_message(REPORT_LAST_TIMESTAMP, "Set break timout to %imsecs\n", options.break_timeout);
@@ -566,37 +761,37 @@ int main(int argc, char **argv)
 		if (streq("-d", argv[i]) || streq("--drag", argv[i])) {
 			if (!xemu.pointer.dev) {
 				fprintf(stderr, "Failed to open pointer device, unable to simulate pointer events.\n");
-				exit(-1);
+				goto error;
 			}
 			if (inputEventsIndex == ASIZE(inputEvents)) {
 				fprintf(stderr, "Too many input events specified\n");
-				exit(-1);
+				goto error;
 			}
 			if (!argv[i + 1] || (!match_regex(argv[i + 1], "^([0-9]+,)?(([0-9]+x[0-9]+,([0-9]+,)?)+[0-9]+x[0-9]+)$") &&
 				 (!match_regex(argv[i + 1], "[0-9]+x[0-9]+-[0-9]+x[0-9]+") ||
 				  !match_regex(argv[i + 1], "^(((([0-9]+,)?([0-9]+x[0-9]+)|([0-9]+x[0-9]+-[0-9]+x[0-9]+(\\*[0-9]+)?(\\+[1-9][0-9]*)?)),?)+)$") ) ) ) {
 				fprintf(stderr, "Failed to parse --drag options: %s\n", argv[i + 1]);
-				exit(-1);
+				goto error;
 			}
 			inputEvents[inputEventsIndex++] = i;
 
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 			continue;
 		}
 
 		if (streq("-k", argv[i]) || streq("--key", argv[i])) {
 			if (!xemu.keyboard.dev) {
 				fprintf(stderr, "Failed to open keyboard device, unable to simulate keyboard events.\n");
-				exit(-1);
+				goto error;
 			}
 			if (inputEventsIndex == ASIZE(inputEvents)) {
 				fprintf(stderr, "Too many input events specified\n");
-				exit(-1);
+				goto error;
 			}
 			inputEvents[inputEventsIndex++] = i;
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 
 			continue;
 		}
@@ -604,19 +799,19 @@ int main(int argc, char **argv)
 		if (streq("-t", argv[i]) || streq("--type", argv[i])) {
 			if (!xemu.keyboard.dev) {
 				fprintf(stderr, "Failed to open keyboard device, unable to simulate keyboard events.\n");
-				exit(-1);
+				goto error;
 			}
 			if (inputEventsIndex == ASIZE(inputEvents)) {
 				fprintf(stderr, "Too many input events specified\n");
-				exit(-1);
+				goto error;
 			}
 			inputEvents[inputEventsIndex++] = i;
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 
-			if (!keysymMappingInitialized) {
+			if (!keymap_loaded) {
 				xemu_load_keycodes();
-				keysymMappingInitialized = True;
+				keymap_loaded = true;
 			}
 
 			continue;
@@ -632,47 +827,273 @@ int main(int argc, char **argv)
 		/* */
 		if (streq("-u", argv[i]) || streq("--user", argv[i]) ||
 				(xrecord.motion = (streq("-U", argv[i]) || streq("--user-all", argv[i])) ) ) {
-			xinput_init(xhandler.display);
+			if (!xinput_init(xhandler.display)) {
+				fprintf(stderr, "*** failed to initialize user input monitoring\n");
+				goto error;
+			}
 			if (verbose)
 				report_add_message(REPORT_LAST_TIMESTAMP, "Reporting user input events\n");
 
 			continue;
 		}
 
+		if (streq(argv[i], "-M") || streq(argv[i], "--motion-log")) {
+			if (++i >= argc)
+				goto usage_error;
+			if (!xinput_set_motion_log(argv[i])) {
+				fprintf(stderr, "*** failed to open motion log '%s'\n", argv[i]);
+				goto error;
+			}
+			if (!xinput_init(xhandler.display)) {
+				fprintf(stderr, "*** failed to initialize user input monitoring\n");
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Logging pointer motion to %s\n", argv[i]);
+
+			continue;
+		}
+
 		if (streq(argv[i], "-r") || streq(argv[i], "--response")) {
 			if (++i >= argc)
-				usage(argv[0]);
+				goto usage_error;
 			char option[500];
 			cnt = sscanf(argv[i], "%u,%s", &response.timeout, option);
 			if (cnt < 1) {
 				fprintf(stderr, "*** invalid response timeout value '%s'\n", argv[i]);
-				usage(argv[0]);
+				goto usage_error;
 			}
 			if (cnt < 2) {
 				report_set_silent(true);
 			} else {
 				if (strcmp(option, "verbose")) {
 					fprintf(stderr, "*** invalid response option '%s'\n", argv[i]);
-					usage(argv[0]);
+					goto usage_error;
 				}
 			}
 			application_monitor_screen();
-			xinput_init(xhandler.display);
+			if (!xinput_init(xhandler.display)) {
+				fprintf(stderr, "*** failed to initialize user input monitoring\n");
+				goto error;
+			}
 			if (verbose)
 				report_add_message(REPORT_LAST_TIMESTAMP, "Monitoring application response time\n");
 
 			continue;
 		}
 
+		if (streq(argv[i], "-S") || streq(argv[i], "--settle")) {
+			if (++i >= argc)
+				goto usage_error;
+			response.settle = atoi(argv[i]);
+			if (!response.settle) {
+				fprintf(stderr, "*** invalid quiet period '%s'\n", argv[i]);
+				goto usage_error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Ending response checking after %ums without damage\n",
+						response.settle);
+
+			continue;
+		}
+
+		if (streq(argv[i], "-Q") || streq(argv[i], "--settle-ignore")) {
+			if (++i >= argc)
+				goto usage_error;
+			if (!filter_add(argv[i], FILTER_RULE_IGNORE)) {
+				fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
+				goto usage_error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Ignoring damage areas matching %s when settling\n", argv[i]);
+			continue;
+		}
+
+		if (streq(argv[i], "-I") || streq(argv[i], "--idle")) {
+			if (++i >= argc)
+				goto usage_error;
+			int timeout = atoi(argv[i]);
+			if (timeout <= 0) {
+				fprintf(stderr, "*** invalid idle period '%s'\n", argv[i]);
+				goto usage_error;
+			}
+			idle_init(timeout * 1000, xhandler_get_server_time());
+			if (!xinput_init(xhandler.display)) {
+				fprintf(stderr, "*** failed to initialize user input monitoring\n");
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Reporting damage while idle for %i secs\n", timeout);
+
+			continue;
+		}
+
+		if (streq(argv[i], "-R") || streq(argv[i], "--root-damage")) {
+			root_damage = true;
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Attributing root window damage to windows\n");
+
+			continue;
+		}
+
+		if (streq(argv[i], "-C") || streq(argv[i], "--compositor")) {
+			compositor_delay = true;
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Measuring compositing delay\n");
+
+			continue;
+		}
+
+		if (streq(argv[i], "-H") || streq(argv[i], "--heatmap")) {
+			if (++i >= argc)
+				goto usage_error;
+			char filename[PATH_MAX];
+			int cell_size = HEATMAP_DEFAULT_CELL_SIZE;
+			const char* separator = strchr(argv[i], ',');
+			size_t length = separator ? (size_t)(separator - argv[i]) : strlen(argv[i]);
+			if (separator) cell_size = atoi(separator + 1);
+			if (!length || length >= sizeof(filename) || cell_size <= 0) {
+				fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
+				goto usage_error;
+			}
+			snprintf(filename, sizeof(filename), "%.*s", (int)length, argv[i]);
+			if (!heatmap_init(filename, DisplayWidth(xhandler.display, DefaultScreen(xhandler.display)),
+					DisplayHeight(xhandler.display, DefaultScreen(xhandler.display)), cell_size)) {
+				fprintf(stderr, "*** failed to initialize damage heatmap\n");
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Writing damage heatmap to %s (cell size %d)\n",
+						filename, cell_size);
+
+			continue;
+		}
+
+		if (streq(argv[i], "-V") || streq(argv[i], "--verify")) {
+			if (!content_init(xhandler.display, true)) {
+				fprintf(stderr, "*** damaged content verification requires MIT-SHM extension\n");
+				goto error;
+			}
+			verify = true;
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Verifying damaged content changes\n");
+
+			continue;
+		}
+
+		if (streq(argv[i], "-D") || streq(argv[i], "--framebuffer")) {
+			if (++i >= argc)
+				goto usage_error;
+
+			if (!content_map_framebuffer(xhandler.display, argv[i])) {
+				fprintf(stderr, "*** failed to map 32 bit per pixel screen framebuffer %s\n", argv[i]);
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Reading screen content from framebuffer %s\n", argv[i]);
+
+			continue;
+		}
+
+		if (streq(argv[i], "-E") || streq(argv[i], "--until-image")) {
+			if (++i >= argc)
+				goto usage_error;
+
+			if (!reference_init(xhandler.display, argv[i])) {
+				fprintf(stderr, "*** failed to initialize reference image condition\n");
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Waiting for reference image %s\n", argv[i]);
+
+			continue;
+		}
+
+		if (streq(argv[i], "-F") || streq(argv[i], "--speed-index")) {
+			if (++i >= argc)
+				goto usage_error;
+
+			if (!visual_init(xhandler.display, argv[i])) {
+				fprintf(stderr, "*** failed to initialize speed index measurement\n");
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Measuring speed index %s\n", argv[i]);
+
+			continue;
+		}
+
+		if (streq(argv[i], "-B") || streq(argv[i], "--flight-recorder")) {
+			if (++i >= argc)
+				goto usage_error;
+
+			if (!recorder_init(xhandler.display, argv[i])) {
+				fprintf(stderr, "*** failed to initialize flight recorder\n");
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Recording slow responses %s\n", argv[i]);
+
+			continue;
+		}
+
+		if (streq(argv[i], "-P") || streq(argv[i], "--present")) {
+			if (!present_init(xhandler.display)) {
+				fprintf(stderr, "*** frame completion monitoring requires Present extension\n");
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Monitoring frame completion\n");
+
+			continue;
+		}
+
+		if (streq(argv[i], "-T") || streq(argv[i], "--timeline")) {
+			if (++i >= argc)
+				goto usage_error;
+			if (!timeline_init(argv[i])) {
+				fprintf(stderr, "*** failed to open response timeline file %s\n", argv[i]);
+				goto error;
+			}
+			if (verbose)
+				report_add_message(REPORT_LAST_TIMESTAMP, "Writing response timeline to %s\n", argv[i]);
+
+			continue;
+		}
+
 		fprintf(stderr, "*** Dont understand  %s\n", argv[i]);
-		usage(argv[0]);
+		goto usage_error;
 	}
 
 	/* start monitoring the root window if no targets are specified */
-	if ((window_empty() && application_empty()) || response.timeout) {
+	if (application_empty() || response.timeout) {
 		application_monitor(ROOT_WINDOW_RESOURCE);
 	}
 
+	if (root_damage) {
+		/* the split root damage pieces share the screen tiles, so the first piece
+		 * verifying them would turn the other pieces into no-op damage */
+		if (verify) {
+			fprintf(stderr, "*** damaged content can't be verified in root damage mode\n");
+			goto error;
+		}
+		if (!window_monitor_root_damage()) {
+			fprintf(stderr, "*** failed to create root window damage object\n");
+			goto error;
+		}
+		stacking_init(xhandler.display);
+	}
+
+	if (compositor_delay) {
+		if (root_damage) {
+			fprintf(stderr, "*** compositing delay can't be measured in root damage mode\n");
+			goto error;
+		}
+		if (!compositor_init(xhandler.display)) {
+			fprintf(stderr, "Warning, no compositing manager detected, compositing delay is not measured\n");
+		}
+	}
+
 	window_monitor_all();
 	application_start_monitor();
 
@@ -680,14 +1101,9 @@ int main(int argc, char **argv)
 	if (options.break_on_damage)
 		xhandler_eat_damage();
 
-	/* monitor the whole screen of no area is specified */
-	if (!options.interested_damage_rect.width && !options.interested_damage_rect.height && !options.interested_damage_rect.x
-			&& !options.interested_damage_rect.y) {
-		options.interested_damage_rect.x = 0;
-		options.interested_damage_rect.y = 0;
-		options.interested_damage_rect.width = DisplayWidth(xhandler.display, DefaultScreen(xhandler.display));
-		options.interested_damage_rect.height = DisplayHeight(xhandler.display, DefaultScreen(xhandler.display));
-	}
+	/* index the monitored areas, monitoring the whole screen if no area is specified */
+	area_init(DisplayWidth(xhandler.display, DefaultScreen(xhandler.display)),
+			DisplayHeight(xhandler.display, DefaultScreen(xhandler.display)));
 
 	/* emulate user input */
 
@@ -705,7 +1121,7 @@ int main(int argc, char **argv)
 			} else if (cnt != 3) {
 				fprintf(stderr, "cnt: %d\n", cnt);
 				fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
-				usage(argv[0]);
+				goto usage_error;
 			}
 			/* Send the event */
 			start = xemu_button_event(x, y, delay);
@@ -751,7 +1167,7 @@ int main(int argc, char **argv)
 					if (!p) {
 						if (button_state == XR_BUTTON_STATE_PRESS) {
 							fprintf(stderr, "*** Need at least 2 drag points!\n");
-							usage(argv[0]);
+							goto usage_error;
 						}
 						button_state = XR_BUTTON_STATE_RELEASE;
 					}
@@ -767,7 +1183,7 @@ int main(int argc, char **argv)
 					delay = x1;
 				} else {
 					fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
-					usage(argv[0]);
+					goto usage_error;
 				}
 				s = p;
 			}
@@ -789,7 +1205,7 @@ int main(int argc, char **argv)
 				fprintf(stderr, "*** failed to parse '%s'\n", argv[i]);
 				if (key != NULL)
 					free(key);
-				usage(argv[0]);
+				goto usage_error;
 			}
 			start = xemu_send_key(key, delay);
 			report_add_message(start, "Simulating keypress/-release pair (keycode '%s')\n", key);
@@ -816,18 +1232,128 @@ int main(int argc, char **argv)
 	/* wait for damage events */
 	rc = wait_response();
 
-	scheduler_fini();
+	idle_report();
+	xinput_report();
+	timeline_report();
+	content_report();
+	area_report();
+	filter_report();
+	heatmap_write();
+
+out:
+	session_fini();
+	return rc;
+
+usage_error:
+	usage(argv[0]);
+	rc = 1;
+	goto out;
+
+error:
+	rc = -1;
+	goto out;
+}
+
 
+/**
+ * Runs the measurement sessions received from control socket.
+ *
+ * The display connection, input devices, keysym mapping, the window
+ * tree mirror and the monitored windows are kept between the sessions,
+ * so a session doesn't pay their initialization cost. An interrupt signal
+ * while waiting for a session, or a second one during a session stops
+ * the daemon.
+ * @param[in] progname   the program name.
+ * @param[in] path       the control socket path.
+ * @return               the exit code.
+ */
+static int run_daemon(char* progname, const char* path)
+{
+	int argc;
+	char** argv;
+
+	/* populate the window tree mirror for the sessions */
+	report_init(NULL);
+	report_add_message(xhandler_get_server_time(), "Startup\n");
+	window_scan_begin(DefaultRootWindow(xhandler.display));
+	application_start_monitor();
 	report_flush_queue();
 	report_fini();
-	xinput_fini();
-	xemu_fini();
+
+	if (!control_init(path)) {
+		fprintf(stderr, "*** failed to create control socket %s\n", path);
+		return -1;
+	}
+	fprintf(stdout, "Waiting for measurement sessions on %s\n", path);
+	fflush(stdout);
+
+	daemon_mode = true;
+	/* the clients disconnecting during sessions must not terminate the daemon */
+	signal(SIGPIPE, SIG_IGN);
+	signal(SIGINT, abort_wait);
+
+	while (true) {
+		options.damage_wait_secs = -1;
+		options.break_on_damage = 0;
+		options.break_timeout = 0;
+		options.abort_wait = false;
+		interrupts = 0;
+
+		if (!control_accept(progname, &argc, &argv))
+			break;
+
+		run_session(argc, argv);
+		control_close();
+		g_strfreev(argv);
+
+		if (interrupts > 1)
+			break;
+	}
+	control_fini();
+
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	int rc;
+	const char* socket_path = NULL;
+
+	if (argc == 1) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	if (streq(argv[1], "-L") || streq(argv[1], "--daemon")) {
+		if (argc != 3) {
+			usage(argv[0]);
+			return 1;
+		}
+		socket_path = argv[2];
+	}
+
+	if (!xhandler_init(getenv("DISPLAY")))
+		exit(1);
+
+	/* initialize the subsystems kept between measurement sessions */
+	wincache_init(xhandler.display);
+	xemu_init(xhandler.display);
+	window_init(xhandler.display);
+	application_init();
+
+	if (socket_path) {
+		rc = run_daemon(argv[0], socket_path);
+	}
+	else {
+		rc = run_session(argc, argv);
+	}
 
 	window_fini();
 	application_fini();
-
+	xemu_fini();
+	wincache_fini();
 	xhandler_fini();
 
-
 	return rc;
 }
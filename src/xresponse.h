@@ -53,14 +53,9 @@ typedef struct Rectangle {
 /* options data structure */
 typedef struct {
 	int damage_wait_secs; /* Max time to collect damamge */
-	Rectangle interested_damage_rect; /* Damage rect to monitor */
 	int break_on_damage; /* break on the specified damage event */
 	bool abort_wait; /* forces to abort damage wait loop if set to true */
 
-	Rectangle exclude_rect;  /* Damage rectangle for filtering rules */
-	unsigned int exclude_size; /* Damage rectangle size for filtering rules */
-	unsigned int exclude_rules; /* damage filtering rules */
-
 	unsigned int break_timeout;
 } options_t;
 